@@ -0,0 +1,90 @@
+#pragma once
+
+#include <istream>
+#include <mutex>
+#include <optional>
+#include <ostream>
+#include <string>
+#include <tuple>
+#include <type_traits>
+#include <cstddef>
+#include <cstdint>
+
+#include "layout.hpp"
+#include "search.hpp"
+#include "state_store.hpp"
+
+// One state store per supported board type
+template<typename Boards>
+struct batch_arena;
+
+template<typename... Boards>
+struct batch_arena<std::tuple<Boards...>> {
+    std::tuple<basic_state_store<Boards>...> stores;
+
+    template<typename Board>
+    basic_state_store<Board> &store() {
+        return std::get<basic_state_store<Board>>(stores);
+    }
+};
+
+// Solves every layout read from input (one per line, with rows separated by '/') with a breadth-first search, on
+// thread_count threads. Each thread keeps its own arena of state stores, which is cleared between layouts instead of
+// being reallocated. A record is written to output as soon as a layout is done, so records come out in completion
+// order, each starting with the index of its layout in the input (counting from 0, empty lines excluded):
+//
+// - "<index> solved <moves> <boards>" if the layout was solved, after discovering the given number of boards
+// - "<index> unsolvable <boards>" if the search ran out of boards
+// - "<index> invalid" if the line isn't a valid layout, or one the solver isn't compiled for
+//
+// Returns the number of layouts read.
+inline size_t solve_batch(std::istream &input, std::ostream &output, size_t thread_count) {
+    std::mutex input_mutex;
+    std::mutex output_mutex;
+    size_t layout_count = 0;
+    run_threads(thread_count, [&](size_t) {
+        batch_arena<supported_boards> arena;
+        std::string line;
+        while (true) {
+            size_t index;
+            {
+                std::lock_guard lock(input_mutex);
+                while (std::getline(input, line) && line.find_first_not_of(" \t\r") == std::string::npos) { }
+                if (!input) {
+                    return;
+                }
+
+                index = layout_count++;
+            }
+
+            std::optional<uint32_t> moves;
+            size_t board_count = 0;
+            std::optional<board_layout> layout = parse_layout(line);
+            bool supported = layout && with_board(*layout, [&](const auto &board) {
+                using board_type = std::decay_t<decltype(board)>;
+                basic_state_store<board_type> &states = arena.store<board_type>();
+                states.clear();
+                states.insert(board.key(), basic_state_store<board_type>::no_parent);
+                if (uint32_t id = breadth_first_search(states); id != basic_state_store<board_type>::no_parent) {
+                    moves = static_cast<uint32_t>(states.layer(id));
+                }
+
+                board_count = states.size();
+            });
+
+            std::lock_guard lock(output_mutex);
+            output << index;
+            if (!supported) {
+                output << " invalid\n";
+            } else if (moves) {
+                output << " solved " << *moves << ' ' << board_count << '\n';
+            } else {
+                output << " unsolvable " << board_count << '\n';
+            }
+
+            output.flush();
+        }
+    });
+
+    return layout_count;
+}
@@ -0,0 +1,282 @@
+#include <array>
+#include <charconv>
+#include <chrono>
+#include <functional>
+#include <iomanip>
+#include <iostream>
+#include <optional>
+#include <string>
+#include <string_view>
+#include <type_traits>
+#include <utility>
+#include <vector>
+#include <cstddef>
+#include <cstdint>
+
+#include "board.hpp"
+#include "layout.hpp"
+#include "search.hpp"
+#include "search_stats.hpp"
+#include "state_store.hpp"
+
+// Start positions of the end-to-end solve benchmark. The first one also seeds the corpus of the microbenchmarks.
+static constexpr std::array<std::string_view, 3> bench_layouts = {
+    default_layout,
+    "PRRP/PRRP/PBBP/PGGP/G__G",
+    "BBGRRP/G_GRRP/BBGPBB/PG_PG_/P_BB__"
+};
+
+struct bench_result {
+    std::string name;
+    uint64_t nodes = 0;      // Boards processed (expanded, hashed, inserted or looked up)
+    uint64_t successors = 0; // Boards generated from them, if any
+    double seconds = 0;      // Fastest of the repetitions
+};
+
+// Keeps the compiler from optimizing away the work being measured.
+static volatile uint64_t sink;
+
+// Runs fn repetitions times and returns the result of the fastest run. fn returns its node and successor counts.
+template<typename F>
+static bench_result run_bench(std::string name, size_t repetitions, F &&fn) {
+    bench_result result;
+    result.name = std::move(name);
+    for (size_t i = 0; i < repetitions; i++) {
+        auto start = std::chrono::steady_clock::now();
+        auto [nodes, successors] = fn();
+        std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - start;
+        if (i == 0 || elapsed.count() < result.seconds) {
+            result.seconds = elapsed.count();
+        }
+
+        result.nodes = nodes;
+        result.successors = successors;
+    }
+
+    return result;
+}
+
+// Every board reachable from the Royal Escape board before it is solved, in breadth-first order
+static std::vector<game_board> make_corpus() {
+    state_store states;
+    states.insert(make_board<game_board>(*parse_layout(default_layout)).key(), state_store::no_parent);
+    breadth_first_search(states);
+
+    std::vector<game_board> corpus;
+    corpus.reserve(states.size());
+    for (uint32_t id = 0; id < states.size(); id++) {
+        corpus.emplace_back(states.key(id));
+    }
+
+    return corpus;
+}
+
+static std::vector<bench_result> run_benches(size_t repetitions) {
+    using move_method = bool (game_board::*)(game_board::bitboard &);
+    static constexpr std::array<move_method, 12> move_methods = {
+        &game_board::move_piece_up_twice, &game_board::move_piece_down_twice, &game_board::move_piece_left_twice,
+        &game_board::move_piece_right_twice, &game_board::move_piece_up_left, &game_board::move_piece_up_right,
+        &game_board::move_piece_bottom_left, &game_board::move_piece_bottom_right, &game_board::move_piece_up,
+        &game_board::move_piece_down, &game_board::move_piece_left, &game_board::move_piece_right
+    };
+
+    std::vector<game_board> corpus = make_corpus();
+    // Keys of the boards reached from the corpus, with the hashes they carry
+    std::vector<std::pair<board_key, size_t>> successor_keys;
+    for (const game_board &board : corpus) {
+        board.generate_moves([&](const game_board &new_board) {
+            successor_keys.emplace_back(new_board.key(), new_board.hash());
+        });
+    }
+
+    std::vector<bench_result> results;
+    results.push_back(run_bench("move_piece", repetitions, [&] {
+        uint64_t successors = 0;
+        for (const game_board &board : corpus) {
+            for (size_t i = 0; i < board.pieces.size(); i++) {
+                for (move_method method : move_methods) {
+                    game_board new_board = board;
+                    successors += (new_board.*method)(new_board.pieces[i]);
+                }
+            }
+        }
+
+        return std::pair<uint64_t, uint64_t>(corpus.size(), successors);
+    }));
+
+    results.push_back(run_bench("generate_moves", repetitions, [&] {
+        uint64_t successors = 0;
+        uint64_t checksum = 0;
+        for (const game_board &board : corpus) {
+            board.generate_moves([&](const game_board &new_board) {
+                checksum += new_board.pieces[game_board::red_index].bits;
+                successors++;
+            });
+        }
+
+        sink = checksum;
+        return std::pair<uint64_t, uint64_t>(corpus.size(), successors);
+    }));
+
+    // Each legality kernel the CPU supports, the one generate_moves uses included
+    std::vector<std::pair<std::string, legal_moves_kernel<game_board>>> kernels = {
+        { "scalar", legal_moves_scalar<game_board> }
+    };
+#if defined(__x86_64__) || defined(__i386__)
+    if (__builtin_cpu_supports("sse4.1")) {
+        kernels.emplace_back("sse4", legal_moves_sse4<game_board>);
+    }
+
+    if (__builtin_cpu_supports("avx2")) {
+        kernels.emplace_back("avx2", legal_moves_avx2<game_board>);
+    }
+#endif
+
+    for (auto [kernel_name, kernel] : kernels) {
+        results.push_back(run_bench("legal_moves/" + kernel_name, repetitions, [&, kernel = kernel] {
+            uint64_t successors = 0;
+            std::array<uint16_t, game_board::piece_count> masks;
+            for (const game_board &board : corpus) {
+                kernel(board, masks);
+                for (uint16_t mask : masks) {
+                    successors += __builtin_popcount(mask);
+                }
+            }
+
+            return std::pair<uint64_t, uint64_t>(corpus.size(), successors);
+        }));
+    }
+
+    results.push_back(run_bench("hash", repetitions, [&] {
+        uint64_t checksum = 0;
+        for (const game_board &board : corpus) {
+            checksum += std::hash<game_board>()(board);
+        }
+
+        sink = checksum;
+        return std::pair<uint64_t, uint64_t>(corpus.size(), 0);
+    }));
+
+    // Hashing a key from scratch, as the visited set does when it inserts a new board (boards update their own hash
+    // as they move)
+    results.push_back(run_bench("zobrist_hash", repetitions, [&] {
+        uint64_t checksum = 0;
+        for (const game_board &board : corpus) {
+            checksum += game_board::key_hash()(board.key());
+        }
+
+        sink = checksum;
+        return std::pair<uint64_t, uint64_t>(corpus.size(), 0);
+    }));
+
+    state_store states;
+    results.push_back(run_bench("visited_insert", repetitions, [&] {
+        states.clear();
+        for (auto [key, hash] : successor_keys) {
+            states.insert(key, hash, 0);
+        }
+
+        return std::pair<uint64_t, uint64_t>(successor_keys.size(), 0);
+    }));
+
+    results.push_back(run_bench("visited_lookup", repetitions, [&] {
+        uint64_t checksum = 0;
+        for (auto [key, hash] : successor_keys) {
+            checksum += states.find(key, hash);
+        }
+
+        sink = checksum;
+        return std::pair<uint64_t, uint64_t>(successor_keys.size(), 0);
+    }));
+
+    for (std::string_view layout_text : bench_layouts) {
+        std::optional<board_layout> layout = parse_layout(layout_text);
+        with_board(*layout, [&](const auto &board) {
+            using board_type = std::decay_t<decltype(board)>;
+            results.push_back(run_bench("solve/" + std::string(layout_text), repetitions, [&] {
+                basic_state_store<board_type> solve_states;
+                solve_states.insert(board.key(), basic_state_store<board_type>::no_parent);
+                sink = breadth_first_search(solve_states);
+                return std::pair<uint64_t, uint64_t>(solve_states.size(), 0);
+            }));
+        });
+    }
+
+    return results;
+}
+
+// The peak RSS is that of the whole run: the process keeps its high-water mark, so it can't be told apart by benchmark.
+static void print_text(const std::vector<bench_result> &results, long peak_rss) {
+    std::cout << std::left << std::setw(44) << "benchmark" << std::right << std::setw(12) << "nodes"
+              << std::setw(14) << "nodes/s" << std::setw(10) << "ns/node" << std::setw(14) << "ns/successor" << '\n';
+    for (const bench_result &result : results) {
+        std::cout << std::left << std::setw(44) << result.name << std::right << std::setw(12) << result.nodes
+                  << std::fixed << std::setprecision(0) << std::setw(14) << result.nodes / result.seconds
+                  << std::setprecision(2) << std::setw(10) << result.seconds * 1e9 / result.nodes << std::setw(14);
+        if (result.successors) {
+            std::cout << result.seconds * 1e9 / result.successors;
+        } else {
+            std::cout << '-';
+        }
+
+        std::cout << '\n';
+    }
+
+    std::cout << "peak RSS: " << peak_rss << " KB\n";
+}
+
+// One JSON object per benchmark, one per line, so that the output of two builds can be compared line by line. A last
+// one holds the peak RSS of the run.
+static void print_json(const std::vector<bench_result> &results, long peak_rss) {
+    for (const bench_result &result : results) {
+        std::cout << std::setprecision(9) << "{\"name\":\"" << result.name << "\",\"nodes\":" << result.nodes
+                  << ",\"successors\":" << result.successors << ",\"seconds\":" << result.seconds
+                  << ",\"nodes_per_second\":" << result.nodes / result.seconds << ",\"ns_per_successor\":";
+        if (result.successors) {
+            std::cout << result.seconds * 1e9 / result.successors;
+        } else {
+            std::cout << "null";
+        }
+
+        std::cout << "}\n";
+    }
+
+    std::cout << "{\"peak_rss_kb\":" << peak_rss << "}\n";
+}
+
+static bool parse_count(std::string_view arg, size_t &count) {
+    auto [end, error] = std::from_chars(arg.data(), arg.data() + arg.size(), count);
+    return error == std::errc() && end == arg.data() + arg.size();
+}
+
+static void print_usage(const char *name) {
+    std::cerr << "Usage: " << name << " [--json] [--repetitions N]\n"
+              << "  --json           Print one JSON object per benchmark instead of a table\n"
+              << "  --repetitions N  Run each benchmark N times and keep the fastest run (default: 5)\n";
+}
+
+int main(int argc, char *argv[]) {
+    bool json = false;
+    size_t repetitions = 5;
+    for (int i = 1; i < argc; i++) {
+        std::string_view arg = argv[i];
+        if (arg == "--json") {
+            json = true;
+        } else if (arg == "--repetitions" && i + 1 < argc && parse_count(argv[i + 1], repetitions) &&
+                   repetitions > 0) {
+            i++;
+        } else {
+            print_usage(argv[0]);
+            return 2;
+        }
+    }
+
+    std::vector<bench_result> results = run_benches(repetitions);
+    if (json) {
+        print_json(results, peak_rss_kb());
+    } else {
+        print_text(results, peak_rss_kb());
+    }
+
+    return 0;
+}
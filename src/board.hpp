@@ -1,14 +1,16 @@
 #pragma once
 
 #include <array>
+#include <initializer_list>
 #include <iostream>
-#include <typeindex>
+#include <type_traits>
 #include <cassert>
 #include <cstddef>
 #include <cstdint>
 
-#define XXH_INLINE_ALL
-#include <xxhash.h>
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#endif
 
 enum piece_type : uint8_t {
     green  = 0b00,
@@ -17,342 +19,788 @@ enum piece_type : uint8_t {
     red    = 0b11
 };
 
-// This probably only works on little-endian systems (and using a union for type-punning is a GNU extension).
-union piece_bitboard {
-    uint32_t bits;
-    __extension__ struct {
-        uint32_t row_4  : 5;
-        uint32_t row_3  : 5;
-        uint32_t row_2  : 5;
-        uint32_t row_1  : 5;
-        uint32_t type   : 2;
-        uint32_t unused : 10;
-    };
+__extension__ typedef unsigned __int128 uint128_t;
 
-    piece_bitboard(piece_type type, uint8_t row_1, uint8_t row_2, uint8_t row_3, uint8_t row_4)
-      : row_4 {row_4}, row_3 {row_3}, row_2 {row_2}, row_1 {row_1}, type {type}, unused {0} { }
+// Narrowest unsigned integer type with at least Bits bits
+template<size_t Bits>
+using uint_least_t = std::conditional_t<Bits <= 32, uint32_t, std::conditional_t<Bits <= 64, uint64_t, uint128_t>>;
 
-    piece_bitboard(uint32_t type, uint32_t row_1, uint32_t row_2, uint32_t row_3, uint32_t row_4)
-      : row_4 {row_4}, row_3 {row_3}, row_2 {row_2}, row_1 {row_1}, type {type}, unused {0} { }
+// Number of bits needed to store value
+constexpr size_t bit_width(uint64_t value) {
+    size_t width = 0;
+    for (; value; value >>= 1) {
+        width++;
+    }
 
-    piece_bitboard(uint32_t bits)
-      : bits {bits} { }
+    return width;
+}
+
+// Cells covered by each piece type when its lowest cell is the bottom-right cell of a board Width cells wide. Boards
+// are stored as one bit per cell, from the bottom-right cell (bit 0) to the top-left cell, row by row.
+template<size_t Width>
+inline constexpr std::array<uint64_t, 4> piece_shapes = {
+    0b01,                     // piece_type::green (1x1)
+    0b11,                     // piece_type::blue (2x1)
+    0b01 | 0b01 << Width,     // piece_type::purple (1x2)
+    0b11 | 0b11 << Width      // piece_type::red (2x2)
+};
+
+// Returns true if a piece of the given type whose lowest cell is cell fits on the board.
+template<size_t Width, size_t Height>
+constexpr bool piece_fits(uint32_t type, uint32_t cell) {
+    constexpr std::array<uint32_t, 4> widths = { 1, 2, 1, 2 };
+    constexpr std::array<uint32_t, 4> heights = { 1, 1, 2, 2 };
+    return cell < Width * Height && cell % Width + widths[type] <= Width && cell / Width + heights[type] <= Height;
+}
+
+// Random values for Zobrist hashing, one per piece type and cell, drawn from SplitMix64 with a fixed seed
+template<size_t Width, size_t Height>
+constexpr auto make_zobrist_cells() {
+    std::array<std::array<uint64_t, Width * Height>, 4> values {};
+    uint64_t state = 0;
+    for (auto &type_values : values) {
+        for (uint64_t &value : type_values) {
+            uint64_t mix = state += 0x9e3779b97f4a7c15ULL;
+            mix = (mix ^ mix >> 30U) * 0xbf58476d1ce4e5b9ULL;
+            mix = (mix ^ mix >> 27U) * 0x94d049bb133111ebULL;
+            value = mix ^ mix >> 31U;
+        }
+    }
+
+    return values;
+}
+
+template<size_t Width, size_t Height>
+inline constexpr auto zobrist_cells = make_zobrist_cells<Width, Height>();
+
+// Zobrist value of a piece of each type, indexed by its lowest cell: the values of every cell it covers, combined.
+// Moving a piece changes the hash of a board by the values of the piece before and after the move.
+template<size_t Width, size_t Height>
+constexpr auto make_zobrist_pieces() {
+    std::array<std::array<uint64_t, Width * Height>, 4> values {};
+    for (uint32_t type = 0; type < 4; type++) {
+        for (uint32_t cell = 0; cell < Width * Height; cell++) {
+            if (!piece_fits<Width, Height>(type, cell)) {
+                continue;
+            }
+
+            for (uint64_t cells = piece_shapes<Width>[type] << cell; cells; cells &= cells - 1) {
+                values[type][cell] ^= zobrist_cells<Width, Height>[type][__builtin_ctzll(cells)];
+            }
+        }
+    }
+
+    return values;
+}
+
+template<size_t Width, size_t Height>
+inline constexpr auto zobrist_pieces = make_zobrist_pieces<Width, Height>();
+
+// A single piece on a board of Cells cells: the cells it covers, with its type in the two bits above them.
+template<size_t Cells>
+struct piece_bitboard {
+    using word_type = uint_least_t<Cells + 2>;
+
+    static constexpr word_type cells_mask = (word_type {1} << Cells) - 1;
+
+    word_type bits;
+
+    piece_bitboard() = default;
+
+    constexpr piece_bitboard(piece_type type, word_type cells)
+      : bits {static_cast<word_type>(static_cast<word_type>(type) << Cells | cells)} { }
+
+    constexpr piece_type type() const {
+        return static_cast<piece_type>(bits >> Cells);
+    }
+
+    constexpr word_type cells() const {
+        return bits & cells_mask;
+    }
 
     bool operator==(const piece_bitboard &rhs) const {
         return bits == rhs.bits;
     }
 };
 
-static_assert(sizeof(piece_bitboard) == sizeof(uint32_t));
+static_assert(sizeof(piece_bitboard<20>) == sizeof(uint32_t));
+
+// Canonical packed representation of a board. Pieces of the same type are interchangeable, so boards that only differ
+// by swapping two such pieces map to the same key. The green, blue and purple pieces are stored as occupancy masks;
+// the red piece always covers a 2x2 area, so only the position of its bottom-right cell is stored, above the masks.
+template<size_t Width, size_t Height>
+struct basic_board_key {
+    static constexpr size_t cell_count = Width * Height;
+    static constexpr size_t red_bits = bit_width((Height - 2) * Width + Width - 2);
+
+    static_assert(cell_count * 3 + red_bits <= 128, "Board keys are limited to 128 bits");
+
+    using cells_type = uint_least_t<cell_count>;
+    using word_type = uint_least_t<cell_count * 3 + red_bits>;
+
+    static constexpr word_type cells_mask = (word_type {1} << cell_count) - 1;
+
+    word_type bits;
+
+    basic_board_key(cells_type green, cells_type blue, cells_type purple, cells_type red)
+      : bits {static_cast<word_type>(green) | static_cast<word_type>(blue) << cell_count |
+              static_cast<word_type>(purple) << (cell_count * 2) |
+              static_cast<word_type>(__builtin_ctzll(red)) << (cell_count * 3)} { }
+
+    explicit basic_board_key(word_type bits)
+      : bits {bits} { }
+
+    cells_type green() const {
+        return static_cast<cells_type>(bits & cells_mask);
+    }
+
+    cells_type blue() const {
+        return static_cast<cells_type>(bits >> cell_count & cells_mask);
+    }
+
+    cells_type purple() const {
+        return static_cast<cells_type>(bits >> (cell_count * 2) & cells_mask);
+    }
+
+    // Lowest (bottom-right) cell of the red piece
+    uint32_t red() const {
+        return static_cast<uint32_t>(bits >> (cell_count * 3));
+    }
+
+    bool operator==(const basic_board_key &rhs) const {
+        return bits == rhs.bits;
+    }
+};
+
+// Zobrist values of the occupancy masks of a board key, byte by byte: entry [i][value] combines the values of the cells
+// whose bits are set in value, once shifted to byte i of the key. The masks are laid out one after another, so this
+// covers every piece type but the red one.
+template<size_t Width, size_t Height>
+constexpr auto make_zobrist_key_bytes() {
+    constexpr size_t cell_count = Width * Height;
+    std::array<std::array<uint64_t, 256>, (cell_count * 3 + 7) / 8> values {};
+    for (size_t byte = 0; byte < values.size(); byte++) {
+        for (uint32_t value = 0; value < 256; value++) {
+            for (size_t bit = 0; bit < 8; bit++) {
+                size_t key_bit = byte * 8 + bit;
+                if ((value >> bit & 1) && key_bit < cell_count * 3) {
+                    values[byte][value] ^= zobrist_cells<Width, Height>[key_bit / cell_count][key_bit % cell_count];
+                }
+            }
+        }
+    }
+
+    return values;
+}
+
+template<size_t Width, size_t Height>
+inline constexpr auto zobrist_key_bytes = make_zobrist_key_bytes<Width, Height>();
+
+// Zobrist hash of a board key, one table lookup per byte of the key. Boards keep the same hash up to date as their
+// pieces move (see basic_game_board::hash()), so only boards rebuilt from their key need this.
+template<size_t Width, size_t Height>
+struct zobrist_hash {
+    size_t operator()(const basic_board_key<Width, Height> &key) const noexcept {
+        uint64_t hash = zobrist_pieces<Width, Height>[piece_type::red][key.red()];
+        for (size_t byte = 0; byte < zobrist_key_bytes<Width, Height>.size(); byte++) {
+            hash ^= zobrist_key_bytes<Width, Height>[byte][static_cast<uint8_t>(key.bits >> (byte * 8))];
+        }
+
+        return hash;
+    }
+};
+
+// Board of Width x Height cells holding PieceCount pieces, exactly one of them red. Every mask and move table is
+// generated at compile time from the dimensions, so each layout gets its own fully specialized move generator, using
+// the narrowest integer type that holds a piece.
+template<size_t Width, size_t Height, size_t PieceCount>
+class basic_game_board {
+    static_assert(Width >= 2 && Height >= 2, "The red piece needs at least 2x2 cells");
+
+public:
+    static constexpr size_t width = Width;
+    static constexpr size_t height = Height;
+    static constexpr size_t cell_count = Width * Height;
+    static constexpr size_t piece_count = PieceCount;
+
+    using bitboard = piece_bitboard<cell_count>;
+    using word_type = typename bitboard::word_type;
+    using key_type = basic_board_key<Width, Height>;
+    using key_hash = zobrist_hash<Width, Height>;
 
-class game_board {
 private:
-    inline bool move_piece_common(piece_bitboard &piece, piece_bitboard new_piece) {
-        uint32_t all_pieces_mask = 0;
+    // Zobrist hash of the board, updated by every move
+    uint64_t zobrist = 0;
+
+    static uint64_t piece_hash(bitboard piece) {
+        return zobrist_pieces<Width, Height>[piece.type()][__builtin_ctzll(piece.cells())];
+    }
+
+    void place_piece(bitboard &piece, word_type new_cells) {
+        bitboard new_piece(piece.type(), new_cells);
+        zobrist ^= piece_hash(piece) ^ piece_hash(new_piece);
+        piece = new_piece;
+    }
+
+    static constexpr word_type type_bits(uint32_t type) {
+        return static_cast<word_type>(static_cast<word_type>(type) << cell_count);
+    }
+
+    // Cells of rows first to last, counted from the top
+    static constexpr word_type rows(size_t first, size_t last) {
+        word_type mask = 0;
+        for (size_t row = first; row <= last; row++) {
+            mask |= static_cast<word_type>(((word_type {1} << Width) - 1) << ((Height - 1 - row) * Width));
+        }
+
+        return mask;
+    }
+
+    // Cells of columns first to last, counted from the left
+    static constexpr word_type columns(size_t first, size_t last) {
+        word_type mask = 0;
+        for (size_t row = 0; row < Height; row++) {
+            for (size_t column = first; column <= last; column++) {
+                mask |= static_cast<word_type>(word_type {1} << (row * Width + Width - 1 - column));
+            }
+        }
+
+        return mask;
+    }
+
+    inline bool move_piece_common(bitboard &piece, word_type new_cells) {
+        word_type all_pieces_mask = 0;
         for (auto piece : pieces) {
-            all_pieces_mask |= piece.bits;
+            all_pieces_mask |= piece.cells();
         }
 
-        all_pieces_mask &= ~(piece.bits);
-        if (new_piece.bits & all_pieces_mask) {
+        all_pieces_mask &= ~piece.cells();
+        if (new_cells & all_pieces_mask) {
             return false;
         }
 
-        piece = new_piece;
+        place_piece(piece, new_cells);
         return true;
     }
 
-    inline bool move_piece_combo_common(piece_bitboard &piece, piece_bitboard intermediate_piece,
-                                        piece_bitboard new_piece) {
-        uint32_t all_pieces_mask = 0;
+    inline bool move_piece_combo_common(bitboard &piece, word_type intermediate_cells, word_type new_cells) {
+        word_type all_pieces_mask = 0;
         for (auto piece : pieces) {
-            all_pieces_mask |= piece.bits;
+            all_pieces_mask |= piece.cells();
         }
 
-        all_pieces_mask &= ~(piece.bits);
-        if ((intermediate_piece.bits | new_piece.bits) & all_pieces_mask) {
+        all_pieces_mask &= ~piece.cells();
+        if ((intermediate_cells | new_cells) & all_pieces_mask) {
             return false;
         }
 
-        piece = new_piece;
+        place_piece(piece, new_cells);
         return true;
     }
 
-    inline bool move_piece_combo_common(piece_bitboard &piece, piece_bitboard intermediate_piece_1,
-                                        piece_bitboard intermediate_piece_2, piece_bitboard new_piece) {
-        uint32_t all_pieces_mask = 0;
+    inline bool move_piece_combo_common(bitboard &piece, word_type intermediate_cells_1,
+                                        word_type intermediate_cells_2, word_type new_cells) {
+        word_type all_pieces_mask = 0;
         for (auto piece : pieces) {
-            all_pieces_mask |= piece.bits;
+            all_pieces_mask |= piece.cells();
         }
 
-        all_pieces_mask &= ~(piece.bits);
-        if (((intermediate_piece_1.bits | new_piece.bits) & all_pieces_mask) &&
-            ((intermediate_piece_2.bits | new_piece.bits) & all_pieces_mask)) {
+        all_pieces_mask &= ~piece.cells();
+        if (((intermediate_cells_1 | new_cells) & all_pieces_mask) &&
+            ((intermediate_cells_2 | new_cells) & all_pieces_mask)) {
             return false;
         }
 
-        piece = new_piece;
+        place_piece(piece, new_cells);
         return true;
     }
 
 public:
-    static constexpr uint32_t solution_mask          = 0b00'00000'00011'00011'00000UL;
-    static constexpr uint32_t top_row_mask           = 0b00'11111'00000'00000'00000UL;
-    static constexpr uint32_t bottom_row_mask        = 0b00'00000'00000'00000'11111UL;
-    static constexpr uint32_t left_column_mask       = 0b00'10000'10000'10000'10000UL;
-    static constexpr uint32_t right_column_mask      = 0b00'00001'00001'00001'00001UL;
-    static constexpr uint32_t top_two_rows_mask      = 0b01'11111'11111'00000'00000UL;
-    static constexpr uint32_t bottom_two_rows_mask   = 0b01'00000'00000'11111'11111UL;
-    static constexpr uint32_t left_two_columns_mask  = 0b10'11000'11000'11000'11000UL;
-    static constexpr uint32_t right_two_columns_mask = 0b10'00011'00011'00011'00011UL;
-    static constexpr uint32_t top_left_mask          = 0b11'11111'10000'10000'10000UL;
-    static constexpr uint32_t top_right_mask         = 0b11'11111'00001'00001'00001UL;
-    static constexpr uint32_t bottom_left_mask       = 0b11'10000'10000'10000'11111UL;
-    static constexpr uint32_t bottom_right_mask      = 0b11'00001'00001'00001'11111UL;
-
-    std::array<piece_bitboard, 10> pieces = {{
-        { piece_type::blue,   0b11000, 0b00000, 0b00000, 0b00000 },
-        { piece_type::blue,   0b00110, 0b00000, 0b00000, 0b00000 },
-        { piece_type::green,  0b00001, 0b00000, 0b00000, 0b00000 },
-        { piece_type::red,    0b00000, 0b11000, 0b11000, 0b00000 },
-        { piece_type::purple, 0b00000, 0b00100, 0b00100, 0b00000 },
-        { piece_type::green,  0b00000, 0b00010, 0b00000, 0b00000 },
-        { piece_type::green,  0b00000, 0b00000, 0b00010, 0b00000 },
-        { piece_type::blue,   0b00000, 0b00000, 0b00000, 0b11000 },
-        { piece_type::blue,   0b00000, 0b00000, 0b00000, 0b00110 },
-        { piece_type::green,  0b00000, 0b00000, 0b00000, 0b00001 }
-    }};
+    // The type bits in the masks below keep some piece types from making the corresponding moves: only green and
+    // purple pieces can move two cells vertically, only green and blue pieces can move two cells horizontally, and
+    // only green pieces can move around a corner.
+    static constexpr word_type all_cells_mask         = bitboard::cells_mask;
+    static constexpr word_type top_row_mask           = rows(0, 0);
+    static constexpr word_type bottom_row_mask        = rows(Height - 1, Height - 1);
+    static constexpr word_type left_column_mask       = columns(0, 0);
+    static constexpr word_type right_column_mask      = columns(Width - 1, Width - 1);
+    static constexpr word_type top_two_rows_mask      = type_bits(0b01) | rows(0, 1);
+    static constexpr word_type bottom_two_rows_mask   = type_bits(0b01) | rows(Height - 2, Height - 1);
+    static constexpr word_type left_two_columns_mask  = type_bits(0b10) | columns(0, 1);
+    static constexpr word_type right_two_columns_mask = type_bits(0b10) | columns(Width - 2, Width - 1);
+    static constexpr word_type top_left_mask          = type_bits(0b11) | top_row_mask | left_column_mask;
+    static constexpr word_type top_right_mask         = type_bits(0b11) | top_row_mask | right_column_mask;
+    static constexpr word_type bottom_left_mask       = type_bits(0b11) | bottom_row_mask | left_column_mask;
+    static constexpr word_type bottom_right_mask      = type_bits(0b11) | bottom_row_mask | right_column_mask;
+
+    // The exit is on the right side: the red piece has to reach the two rightmost columns of the middle rows (the
+    // upper middle rows if the height is odd).
+    static constexpr word_type solution_mask = rows((Height - 2) / 2, (Height - 2) / 2 + 1) &
+                                               columns(Width - 2, Width - 1);
+
+    // Pieces are ordered by type, so the red piece is always last.
+    std::array<bitboard, PieceCount> pieces;
+
+    static constexpr size_t red_index = PieceCount - 1;
+
+    explicit basic_game_board(const std::array<bitboard, PieceCount> &pieces)
+      : pieces {pieces} {
+        assert(pieces[red_index].type() == piece_type::red);
+        for (auto piece : pieces) {
+            zobrist ^= piece_hash(piece);
+        }
+    }
+
+    explicit basic_game_board(key_type key) {
+        auto it = pieces.begin();
+        for (word_type mask = key.green(); mask; mask &= mask - 1) {
+            *it++ = bitboard(piece_type::green, mask & -mask);
+        }
 
-    static constexpr size_t red_index = 3;
+        // The lowest set bit of a blue piece is its right cell; the lowest set bit of a purple piece is its bottom
+        // cell.
+        for (word_type mask = key.blue(); mask; ) {
+            auto piece_mask = static_cast<word_type>(piece_shapes<Width>[piece_type::blue] << __builtin_ctzll(mask));
+            *it++ = bitboard(piece_type::blue, piece_mask);
+            mask &= ~piece_mask;
+        }
+
+        for (word_type mask = key.purple(); mask; ) {
+            auto piece_mask = static_cast<word_type>(piece_shapes<Width>[piece_type::purple] << __builtin_ctzll(mask));
+            *it++ = bitboard(piece_type::purple, piece_mask);
+            mask &= ~piece_mask;
+        }
 
-    bool move_piece_up(piece_bitboard &piece) {
+        *it++ = bitboard(piece_type::red, static_cast<word_type>(piece_shapes<Width>[piece_type::red] << key.red()));
+        assert(it == pieces.end());
+        for (auto piece : pieces) {
+            zobrist ^= piece_hash(piece);
+        }
+    }
+
+    // Returns true if key is a board made of the same pieces as reference, which the constructor above can decode:
+    // the masks don't overlap, the red piece fits on the board, and every blue and purple mask splits into whole
+    // pieces. Keys read from a file have to be checked before they're decoded.
+    static bool valid_key(key_type key, const basic_game_board &reference) {
+        std::array<size_t, 4> counts = {};
+        for (auto piece : reference.pieces) {
+            counts[piece.type()]++;
+        }
+
+        if (counts[piece_type::red] != 1 || key.bits >> (cell_count * 3) != key.red() ||
+            !piece_fits<Width, Height>(piece_type::red, key.red())) {
+            return false;
+        }
+
+        auto red_cells = static_cast<word_type>(piece_shapes<Width>[piece_type::red] << key.red());
+        word_type green_cells = key.green();
+        word_type blue_cells = key.blue();
+        word_type purple_cells = key.purple();
+        if ((green_cells & blue_cells) || ((green_cells | blue_cells) & purple_cells) ||
+            ((green_cells | blue_cells | purple_cells) & red_cells) ||
+            static_cast<size_t>(__builtin_popcountll(green_cells)) != counts[piece_type::green]) {
+            return false;
+        }
+
+        for (piece_type type : { piece_type::blue, piece_type::purple }) {
+            size_t count = 0;
+            for (word_type mask = type == piece_type::blue ? blue_cells : purple_cells; mask; count++) {
+                auto cell = static_cast<uint32_t>(__builtin_ctzll(mask));
+                auto piece_mask = static_cast<word_type>(piece_shapes<Width>[type] << cell);
+                if (!piece_fits<Width, Height>(type, cell) || (mask & piece_mask) != piece_mask) {
+                    return false;
+                }
+
+                mask &= ~piece_mask;
+            }
+
+            if (count != counts[type]) {
+                return false;
+            }
+        }
+
+        return true;
+    }
+
+    bool move_piece_up(bitboard &piece) {
         if (piece.bits & top_row_mask) {
             return false;
         }
 
-        piece_bitboard new_piece = { piece.type, piece.row_2, piece.row_3, piece.row_4, 0 };
-        return move_piece_common(piece, new_piece);
+        return move_piece_common(piece, piece.cells() << Width);
     }
 
-    bool move_piece_down(piece_bitboard &piece) {
+    bool move_piece_down(bitboard &piece) {
         if (piece.bits & bottom_row_mask) {
             return false;
         }
 
-        piece_bitboard new_piece = { piece.type, 0, piece.row_1, piece.row_2, piece.row_3 };
-        return move_piece_common(piece, new_piece);
+        return move_piece_common(piece, piece.cells() >> Width);
     }
 
-    bool move_piece_left(piece_bitboard &piece) {
+    bool move_piece_left(bitboard &piece) {
         if (piece.bits & left_column_mask) {
             return false;
         }
 
-        piece_bitboard new_piece = {
-            piece.type,
-            static_cast<uint32_t>(piece.row_1 << 1U),
-            static_cast<uint32_t>(piece.row_2 << 1U),
-            static_cast<uint32_t>(piece.row_3 << 1U),
-            static_cast<uint32_t>(piece.row_4 << 1U)
-        };
-
-        return move_piece_common(piece, new_piece);
+        return move_piece_common(piece, piece.cells() << 1U);
     }
 
-    bool move_piece_right(piece_bitboard &piece) {
+    bool move_piece_right(bitboard &piece) {
         if (piece.bits & right_column_mask) {
             return false;
         }
 
-        piece_bitboard new_piece = {
-            piece.type,
-            static_cast<uint32_t>(piece.row_1 >> 1U),
-            static_cast<uint32_t>(piece.row_2 >> 1U),
-            static_cast<uint32_t>(piece.row_3 >> 1U),
-            static_cast<uint32_t>(piece.row_4 >> 1U)
-        };
-
-        return move_piece_common(piece, new_piece);
+        return move_piece_common(piece, piece.cells() >> 1U);
     }
 
-    bool move_piece_up_twice(piece_bitboard &piece) {
+    bool move_piece_up_twice(bitboard &piece) {
         if (piece.bits & top_two_rows_mask) {
             return false;
         }
 
-        piece_bitboard new_piece = { piece.type, piece.row_3, piece.row_4, 0, 0 };
-        piece_bitboard intermediate_piece = { piece.type, piece.row_2, piece.row_3, piece.row_4, 0 };
-        return move_piece_combo_common(piece, intermediate_piece, new_piece);
+        return move_piece_combo_common(piece, piece.cells() << Width, piece.cells() << (Width * 2));
     }
 
-    bool move_piece_down_twice(piece_bitboard &piece) {
+    bool move_piece_down_twice(bitboard &piece) {
         if (piece.bits & bottom_two_rows_mask) {
             return false;
         }
 
-        piece_bitboard new_piece = { piece.type, 0, 0, piece.row_1, piece.row_2 };
-        piece_bitboard intermediate_piece = { piece.type, 0, piece.row_1, piece.row_2, piece.row_3 };
-        return move_piece_combo_common(piece, intermediate_piece, new_piece);
+        return move_piece_combo_common(piece, piece.cells() >> Width, piece.cells() >> (Width * 2));
     }
 
-    bool move_piece_left_twice(piece_bitboard &piece) {
+    bool move_piece_left_twice(bitboard &piece) {
         if (piece.bits & left_two_columns_mask) {
             return false;
         }
 
-        piece_bitboard new_piece = {
-            piece.type,
-            static_cast<uint32_t>(piece.row_1 << 2U),
-            static_cast<uint32_t>(piece.row_2 << 2U),
-            static_cast<uint32_t>(piece.row_3 << 2U),
-            static_cast<uint32_t>(piece.row_4 << 2U)
-        };
-
-        piece_bitboard intermediate_piece = {
-            piece.type,
-            static_cast<uint32_t>(piece.row_1 << 1U),
-            static_cast<uint32_t>(piece.row_2 << 1U),
-            static_cast<uint32_t>(piece.row_3 << 1U),
-            static_cast<uint32_t>(piece.row_4 << 1U)
-        };
-
-        return move_piece_combo_common(piece, intermediate_piece, new_piece);
+        return move_piece_combo_common(piece, piece.cells() << 1U, piece.cells() << 2U);
     }
 
-    bool move_piece_right_twice(piece_bitboard &piece) {
+    bool move_piece_right_twice(bitboard &piece) {
         if (piece.bits & right_two_columns_mask) {
             return false;
         }
 
-        piece_bitboard new_piece = {
-            piece.type,
-            static_cast<uint32_t>(piece.row_1 >> 2U),
-            static_cast<uint32_t>(piece.row_2 >> 2U),
-            static_cast<uint32_t>(piece.row_3 >> 2U),
-            static_cast<uint32_t>(piece.row_4 >> 2U)
-        };
-
-        piece_bitboard intermediate_piece = {
-            piece.type,
-            static_cast<uint32_t>(piece.row_1 >> 1U),
-            static_cast<uint32_t>(piece.row_2 >> 1U),
-            static_cast<uint32_t>(piece.row_3 >> 1U),
-            static_cast<uint32_t>(piece.row_4 >> 1U)
-        };
-
-        return move_piece_combo_common(piece, intermediate_piece, new_piece);
+        return move_piece_combo_common(piece, piece.cells() >> 1U, piece.cells() >> 2U);
     }
 
-    bool move_piece_up_left(piece_bitboard &piece) {
+    bool move_piece_up_left(bitboard &piece) {
         if (piece.bits & top_left_mask) {
             return false;
         }
 
-        piece_bitboard new_piece = {
-            piece.type,
-            static_cast<uint32_t>(piece.row_2 << 1U),
-            static_cast<uint32_t>(piece.row_3 << 1U),
-            static_cast<uint32_t>(piece.row_4 << 1U),
-            0
-        };
-
-        piece_bitboard intermediate_piece_1 = { piece.type, piece.row_2, piece.row_3, piece.row_4, 0 };
-        piece_bitboard intermediate_piece_2 = {
-            piece.type,
-            static_cast<uint32_t>(piece.row_1 << 1U),
-            static_cast<uint32_t>(piece.row_2 << 1U),
-            static_cast<uint32_t>(piece.row_3 << 1U),
-            static_cast<uint32_t>(piece.row_4 << 1U)
-        };
-
-        return move_piece_combo_common(piece, intermediate_piece_1, intermediate_piece_2, new_piece);
+        return move_piece_combo_common(piece, piece.cells() << Width, piece.cells() << 1U,
+                                       piece.cells() << (Width + 1));
     }
 
-    bool move_piece_up_right(piece_bitboard &piece) {
+    bool move_piece_up_right(bitboard &piece) {
         if (piece.bits & top_right_mask) {
             return false;
         }
 
-        piece_bitboard new_piece = {
-            piece.type,
-            static_cast<uint32_t>(piece.row_2 >> 1U),
-            static_cast<uint32_t>(piece.row_3 >> 1U),
-            static_cast<uint32_t>(piece.row_4 >> 1U),
-            0
-        };
-
-        piece_bitboard intermediate_piece_1 = { piece.type, piece.row_2, piece.row_3, piece.row_4, 0 };
-        piece_bitboard intermediate_piece_2 = {
-            piece.type,
-            static_cast<uint32_t>(piece.row_1 >> 1U),
-            static_cast<uint32_t>(piece.row_2 >> 1U),
-            static_cast<uint32_t>(piece.row_3 >> 1U),
-            static_cast<uint32_t>(piece.row_4 >> 1U)
-        };
-
-        return move_piece_combo_common(piece, intermediate_piece_1, intermediate_piece_2, new_piece);
+        return move_piece_combo_common(piece, piece.cells() << Width, piece.cells() >> 1U,
+                                       piece.cells() << (Width - 1));
     }
 
-    bool move_piece_bottom_left(piece_bitboard &piece) {
+    bool move_piece_bottom_left(bitboard &piece) {
         if (piece.bits & bottom_left_mask) {
             return false;
         }
 
-        piece_bitboard new_piece = {
-            piece.type,
-            0,
-            static_cast<uint32_t>(piece.row_1 << 1U),
-            static_cast<uint32_t>(piece.row_2 << 1U),
-            static_cast<uint32_t>(piece.row_3 << 1U)
-        };
-
-        piece_bitboard intermediate_piece_1 = { piece.type, 0, piece.row_1, piece.row_2, piece.row_3 };
-        piece_bitboard intermediate_piece_2 = {
-            piece.type,
-            static_cast<uint32_t>(piece.row_1 << 1U),
-            static_cast<uint32_t>(piece.row_2 << 1U),
-            static_cast<uint32_t>(piece.row_3 << 1U),
-            static_cast<uint32_t>(piece.row_4 << 1U)
-        };
-
-        return move_piece_combo_common(piece, intermediate_piece_1, intermediate_piece_2, new_piece);
+        return move_piece_combo_common(piece, piece.cells() >> Width, piece.cells() << 1U,
+                                       piece.cells() >> (Width - 1));
     }
 
-    bool move_piece_bottom_right(piece_bitboard &piece) {
+    bool move_piece_bottom_right(bitboard &piece) {
         if (piece.bits & bottom_right_mask) {
             return false;
         }
 
-        piece_bitboard new_piece = {
-            piece.type,
-            0,
-            static_cast<uint32_t>(piece.row_1 >> 1U),
-            static_cast<uint32_t>(piece.row_2 >> 1U),
-            static_cast<uint32_t>(piece.row_3 >> 1U)
-        };
-
-        piece_bitboard intermediate_piece_1 = { piece.type, 0, piece.row_1, piece.row_2, piece.row_3 };
-        piece_bitboard intermediate_piece_2 = {
-            piece.type,
-            static_cast<uint32_t>(piece.row_1 >> 1U),
-            static_cast<uint32_t>(piece.row_2 >> 1U),
-            static_cast<uint32_t>(piece.row_3 >> 1U),
-            static_cast<uint32_t>(piece.row_4 >> 1U)
-        };
-
-        return move_piece_combo_common(piece, intermediate_piece_1, intermediate_piece_2, new_piece);
+        return move_piece_combo_common(piece, piece.cells() >> Width, piece.cells() >> 1U,
+                                       piece.cells() >> (Width + 1));
     }
 
+    // Calls callback with every board reachable from this one in a single move.
+    template<typename F>
+    void generate_moves(F &&callback) const;
+
     bool solved() const {
         return (pieces[red_index].bits & solution_mask) == solution_mask;
     }
 
-    bool operator==(const game_board &rhs) const {
+    // Same as key_hash()(key()), without building the key
+    size_t hash() const {
+        return zobrist;
+    }
+
+    key_type key() const {
+        std::array<word_type, 4> type_masks = {};
+        for (auto piece : pieces) {
+            type_masks[piece.type()] |= piece.cells();
+        }
+
+        return { type_masks[piece_type::green], type_masks[piece_type::blue], type_masks[piece_type::purple],
+                 type_masks[piece_type::red] };
+    }
+
+    bool operator==(const basic_game_board &rhs) const {
         return pieces == rhs.pieces;
     }
 };
 
-std::ostream& operator<<(std::ostream &os, const game_board &board) {
+// The Royal Escape board
+using game_board = basic_game_board<5, 4, 10>;
+using board_key = game_board::key_type;
+
+static_assert(sizeof(board_key) == sizeof(uint64_t));
+static_assert(game_board::solution_mask == 0b00'00000'00011'00011'00000UL);
+static_assert(game_board::bottom_left_mask == 0b11'10000'10000'10000'11111UL);
+
+// Moves of a piece, stored move by move in parallel arrays so that they can be checked in vector registers. The arrays
+// are padded to a whole number of registers with moves that are never legal (count masks them out).
+template<typename Word>
+struct alignas(32) piece_moves {
+    static constexpr size_t max_count = 12;
+    static constexpr size_t padded_count = 16;
+
+    std::array<Word, padded_count> cells {};  // Cells covered by the piece after the move
+    std::array<Word, padded_count> path_1 {}; // Cells the piece passes through on the way there; the move is legal if
+    std::array<Word, padded_count> path_2 {}; // either path is free
+    std::array<uint64_t, max_count> hash {};  // Change to the Zobrist hash of the board
+    size_t count = 0;
+};
+
+// Moves available to each piece type on an empty board, indexed by piece type and by the lowest cell covered by the
+// piece. These follow the same rules (and are generated in the same order) as the move_piece_* methods.
+template<typename Board>
+constexpr auto make_move_table() {
+    using word_type = typename Board::word_type;
+
+    struct move_rule {
+        word_type blocked_mask;
+        int shift;
+        int path_1_shift;
+        int path_2_shift;
+    };
+
+    constexpr auto width = static_cast<int>(Board::width);
+    constexpr std::array<move_rule, 12> rules = {{
+        { Board::top_two_rows_mask,       2 * width,  width,  width }, // move_piece_up_twice
+        { Board::bottom_two_rows_mask,   -2 * width, -width, -width }, // move_piece_down_twice
+        { Board::left_two_columns_mask,           2,      1,      1 }, // move_piece_left_twice
+        { Board::right_two_columns_mask,         -2,     -1,     -1 }, // move_piece_right_twice
+        { Board::top_left_mask,           width + 1,  width,      1 }, // move_piece_up_left
+        { Board::top_right_mask,          width - 1,  width,     -1 }, // move_piece_up_right
+        { Board::bottom_left_mask,       -width + 1, -width,      1 }, // move_piece_bottom_left
+        { Board::bottom_right_mask,      -width - 1, -width,     -1 }, // move_piece_bottom_right
+        { Board::top_row_mask,                width,      0,      0 }, // move_piece_up
+        { Board::bottom_row_mask,            -width,      0,      0 }, // move_piece_down
+        { Board::left_column_mask,                1,      0,      0 }, // move_piece_left
+        { Board::right_column_mask,              -1,      0,      0 }  // move_piece_right
+    }};
+
+    auto shift = [](word_type cells, int amount) {
+        return static_cast<word_type>(amount >= 0 ? cells << amount : cells >> -amount);
+    };
+
+    std::array<std::array<piece_moves<word_type>, Board::cell_count>, 4> table {};
+    for (uint32_t type = 0; type < 4; type++) {
+        for (uint32_t cell = 0; cell < Board::cell_count; cell++) {
+            if (!piece_fits<Board::width, Board::height>(type, cell)) {
+                continue;
+            }
+
+            auto cells = static_cast<word_type>(piece_shapes<Board::width>[type] << cell);
+            piece_moves<word_type> &entry = table[type][cell];
+            for (auto rule : rules) {
+                if (typename Board::bitboard(static_cast<piece_type>(type), cells).bits & rule.blocked_mask) {
+                    continue;
+                }
+
+                entry.cells[entry.count] = shift(cells, rule.shift);
+                entry.path_1[entry.count] = shift(cells, rule.path_1_shift);
+                entry.path_2[entry.count] = shift(cells, rule.path_2_shift);
+                entry.hash[entry.count] = zobrist_pieces<Board::width, Board::height>[type][cell] ^
+                                          zobrist_pieces<Board::width, Board::height>[type][cell + rule.shift];
+                entry.count++;
+            }
+        }
+    }
+
+    return table;
+}
+
+template<typename Board>
+inline constexpr auto move_table = make_move_table<Board>();
+
+// Legal moves of every piece of a board: bit j of masks[i] is set if the move j in the move table entry of piece i is
+// legal. There is one implementation per instruction set, all giving the same masks; legal_moves points to the best one
+// the CPU supports.
+template<typename Board>
+using legal_moves_kernel = void (*)(const Board &board, std::array<uint16_t, Board::piece_count> &masks);
+
+template<typename Board>
+void legal_moves_scalar(const Board &board, std::array<uint16_t, Board::piece_count> &masks) {
+    using word_type = typename Board::word_type;
+    word_type all_pieces_mask = 0;
+    for (auto piece : board.pieces) {
+        all_pieces_mask |= piece.cells();
+    }
+
+    for (size_t i = 0; i < Board::piece_count; i++) {
+        word_type cells = board.pieces[i].cells();
+        word_type other_pieces_mask = all_pieces_mask & ~cells;
+        const auto &entry = move_table<Board>[board.pieces[i].type()][__builtin_ctzll(cells)];
+        uint32_t mask = 0;
+        for (size_t j = 0; j < entry.count; j++) {
+            bool legal = !(entry.cells[j] & other_pieces_mask) &&
+                         (!(entry.path_1[j] & other_pieces_mask) || !(entry.path_2[j] & other_pieces_mask));
+            mask |= static_cast<uint32_t>(legal) << j;
+        }
+
+        masks[i] = static_cast<uint16_t>(mask);
+    }
+}
+
+#if defined(__x86_64__) || defined(__i386__)
+// The vector kernels check all the moves of a piece at once: a move is legal if its cells are free and either path is
+// free, lane by lane, and the comparison results are packed into the mask with a movemask. Boards wider than 64 bits
+// don't fit in a lane and use the scalar kernel.
+template<typename Board>
+__attribute__((target("sse4.1")))
+void legal_moves_sse4(const Board &board, std::array<uint16_t, Board::piece_count> &masks) {
+    using word_type = typename Board::word_type;
+    if constexpr (sizeof(word_type) > sizeof(uint64_t)) {
+        legal_moves_scalar(board, masks);
+    } else {
+        static constexpr size_t lane_count = 16 / sizeof(word_type);
+        word_type all_pieces_mask = 0;
+        for (auto piece : board.pieces) {
+            all_pieces_mask |= piece.cells();
+        }
+
+        const __m128i zero = _mm_setzero_si128();
+        for (size_t i = 0; i < Board::piece_count; i++) {
+            word_type cells = board.pieces[i].cells();
+            word_type other_pieces_mask = all_pieces_mask & ~cells;
+            const auto &entry = move_table<Board>[board.pieces[i].type()][__builtin_ctzll(cells)];
+            __m128i other = sizeof(word_type) == sizeof(uint32_t)
+                ? _mm_set1_epi32(static_cast<int>(other_pieces_mask))
+                : _mm_set1_epi64x(static_cast<long long>(other_pieces_mask));
+            uint32_t mask = 0;
+            for (size_t j = 0; j < entry.count; j += lane_count) {
+                __m128i new_cells = _mm_and_si128(_mm_load_si128(reinterpret_cast<const __m128i *>(&entry.cells[j])),
+                                                  other);
+                __m128i path_1 = _mm_and_si128(_mm_load_si128(reinterpret_cast<const __m128i *>(&entry.path_1[j])),
+                                               other);
+                __m128i path_2 = _mm_and_si128(_mm_load_si128(reinterpret_cast<const __m128i *>(&entry.path_2[j])),
+                                               other);
+                if constexpr (sizeof(word_type) == sizeof(uint32_t)) {
+                    __m128i legal = _mm_and_si128(_mm_cmpeq_epi32(new_cells, zero),
+                                                  _mm_or_si128(_mm_cmpeq_epi32(path_1, zero),
+                                                               _mm_cmpeq_epi32(path_2, zero)));
+                    mask |= static_cast<uint32_t>(_mm_movemask_ps(_mm_castsi128_ps(legal))) << j;
+                } else {
+                    __m128i legal = _mm_and_si128(_mm_cmpeq_epi64(new_cells, zero),
+                                                  _mm_or_si128(_mm_cmpeq_epi64(path_1, zero),
+                                                               _mm_cmpeq_epi64(path_2, zero)));
+                    mask |= static_cast<uint32_t>(_mm_movemask_pd(_mm_castsi128_pd(legal))) << j;
+                }
+            }
+
+            masks[i] = static_cast<uint16_t>(mask & ((1U << entry.count) - 1));
+        }
+    }
+}
+
+template<typename Board>
+__attribute__((target("avx2")))
+void legal_moves_avx2(const Board &board, std::array<uint16_t, Board::piece_count> &masks) {
+    using word_type = typename Board::word_type;
+    if constexpr (sizeof(word_type) > sizeof(uint64_t)) {
+        legal_moves_scalar(board, masks);
+    } else {
+        static constexpr size_t lane_count = 32 / sizeof(word_type);
+        word_type all_pieces_mask = 0;
+        for (auto piece : board.pieces) {
+            all_pieces_mask |= piece.cells();
+        }
+
+        const __m256i zero = _mm256_setzero_si256();
+        for (size_t i = 0; i < Board::piece_count; i++) {
+            word_type cells = board.pieces[i].cells();
+            word_type other_pieces_mask = all_pieces_mask & ~cells;
+            const auto &entry = move_table<Board>[board.pieces[i].type()][__builtin_ctzll(cells)];
+            __m256i other = sizeof(word_type) == sizeof(uint32_t)
+                ? _mm256_set1_epi32(static_cast<int>(other_pieces_mask))
+                : _mm256_set1_epi64x(static_cast<long long>(other_pieces_mask));
+            uint32_t mask = 0;
+            for (size_t j = 0; j < entry.count; j += lane_count) {
+                __m256i new_cells = _mm256_and_si256(
+                    _mm256_load_si256(reinterpret_cast<const __m256i *>(&entry.cells[j])), other);
+                __m256i path_1 = _mm256_and_si256(
+                    _mm256_load_si256(reinterpret_cast<const __m256i *>(&entry.path_1[j])), other);
+                __m256i path_2 = _mm256_and_si256(
+                    _mm256_load_si256(reinterpret_cast<const __m256i *>(&entry.path_2[j])), other);
+                if constexpr (sizeof(word_type) == sizeof(uint32_t)) {
+                    __m256i legal = _mm256_and_si256(_mm256_cmpeq_epi32(new_cells, zero),
+                                                     _mm256_or_si256(_mm256_cmpeq_epi32(path_1, zero),
+                                                                     _mm256_cmpeq_epi32(path_2, zero)));
+                    mask |= static_cast<uint32_t>(_mm256_movemask_ps(_mm256_castsi256_ps(legal))) << j;
+                } else {
+                    __m256i legal = _mm256_and_si256(_mm256_cmpeq_epi64(new_cells, zero),
+                                                     _mm256_or_si256(_mm256_cmpeq_epi64(path_1, zero),
+                                                                     _mm256_cmpeq_epi64(path_2, zero)));
+                    mask |= static_cast<uint32_t>(_mm256_movemask_pd(_mm256_castsi256_pd(legal))) << j;
+                }
+            }
+
+            masks[i] = static_cast<uint16_t>(mask & ((1U << entry.count) - 1));
+        }
+    }
+}
+#endif
+
+template<typename Board>
+legal_moves_kernel<Board> select_legal_moves_kernel() {
+#if defined(__x86_64__) || defined(__i386__)
+    __builtin_cpu_init();
+    if (__builtin_cpu_supports("avx2")) {
+        return legal_moves_avx2<Board>;
+    }
+
+    if (__builtin_cpu_supports("sse4.1")) {
+        return legal_moves_sse4<Board>;
+    }
+#endif
+
+    return legal_moves_scalar<Board>;
+}
+
+template<typename Board>
+inline const legal_moves_kernel<Board> legal_moves = select_legal_moves_kernel<Board>();
+
+template<size_t Width, size_t Height, size_t PieceCount>
+template<typename F>
+void basic_game_board<Width, Height, PieceCount>::generate_moves(F &&callback) const {
+    std::array<uint16_t, PieceCount> masks;
+    legal_moves<basic_game_board>(*this, masks);
+    for (size_t i = 0; i < pieces.size(); i++) {
+        const auto &entry = move_table<basic_game_board>[pieces[i].type()][__builtin_ctzll(pieces[i].cells())];
+        for (uint32_t mask = masks[i]; mask; mask &= mask - 1) {
+            size_t j = __builtin_ctz(mask);
+            basic_game_board new_board = *this;
+            new_board.pieces[i] = bitboard(pieces[i].type(), entry.cells[j]);
+            new_board.zobrist ^= entry.hash[j];
+            callback(new_board);
+        }
+    }
+}
+
+template<size_t Width, size_t Height, size_t PieceCount>
+std::ostream& operator<<(std::ostream &os, const basic_game_board<Width, Height, PieceCount> &board) {
     static constexpr std::array<char, 4> piece_type_chars = {
         'G', // piece_type::green
         'B', // piece_type::blue
@@ -360,13 +808,13 @@ std::ostream& operator<<(std::ostream &os, const game_board &board) {
         'R'  // piece_type::red
     };
 
-    uint32_t mask = 0b10000'00000'00000'00000UL;
-    for (size_t i = 0; i < 4; i++) {
-        for (size_t j = 0; j < 5; j++) {
+    uint64_t mask = uint64_t {1} << (Width * Height - 1);
+    for (size_t i = 0; i < Height; i++) {
+        for (size_t j = 0; j < Width; j++) {
             bool piece_present = false;
             for (auto piece : board.pieces) {
-                if (piece.bits & mask) {
-                    os << piece_type_chars[piece.type];
+                if (piece.cells() & mask) {
+                    os << piece_type_chars[piece.type()];
                     piece_present = true;
                     break;
                 }
@@ -376,14 +824,14 @@ std::ostream& operator<<(std::ostream &os, const game_board &board) {
                 os << '_';
             }
 
-            if (j < 4) {
+            if (j < Width - 1) {
                 os << ' ';
             }
 
             mask >>= 1;
         }
 
-        if (i < 3) {
+        if (i < Height - 1) {
             os << '\n';
         }
     }
@@ -392,9 +840,28 @@ std::ostream& operator<<(std::ostream &os, const game_board &board) {
 }
 
 namespace std {
-    template<> struct hash<game_board> {
-        size_t operator()(const game_board &board) const noexcept {
-            return XXH64(board.pieces.data(), board.pieces.size() * sizeof(board.pieces[0]), 39);
+    template<size_t Width, size_t Height>
+    struct hash<basic_board_key<Width, Height>> {
+        size_t operator()(const basic_board_key<Width, Height> &key) const noexcept {
+            // MurmurHash3 64-bit finalizer, after folding the high half of keys wider than 64 bits into the low half
+            auto hash = static_cast<uint64_t>(key.bits);
+            if constexpr (sizeof(key.bits) > sizeof(uint64_t)) {
+                hash ^= static_cast<uint64_t>(key.bits >> 64U) * 0x9e3779b97f4a7c15ULL;
+            }
+
+            hash ^= hash >> 33U;
+            hash *= 0xff51afd7ed558ccdULL;
+            hash ^= hash >> 33U;
+            hash *= 0xc4ceb9fe1a85ec53ULL;
+            hash ^= hash >> 33U;
+            return hash;
+        }
+    };
+
+    template<size_t Width, size_t Height, size_t PieceCount>
+    struct hash<basic_game_board<Width, Height, PieceCount>> {
+        size_t operator()(const basic_game_board<Width, Height, PieceCount> &board) const noexcept {
+            return hash<basic_board_key<Width, Height>>()(board.key());
         }
     };
 }
@@ -0,0 +1,179 @@
+#pragma once
+
+#include <array>
+#include <limits>
+#include <optional>
+#include <cstddef>
+#include <cstdint>
+
+#include "board.hpp"
+
+// Binomial coefficients C(n, k) for n, k <= 40 (the largest board a key can hold)
+constexpr std::array<std::array<uint64_t, 41>, 41> make_binomial_table() {
+    std::array<std::array<uint64_t, 41>, 41> table {};
+    for (size_t n = 0; n < table.size(); n++) {
+        table[n][0] = 1;
+        for (size_t k = 1; k <= n; k++) {
+            table[n][k] = table[n - 1][k - 1] + table[n - 1][k];
+        }
+    }
+
+    return table;
+}
+
+inline constexpr auto binomials = make_binomial_table();
+
+// Mask of the lowest cell of every position where a piece of the given type fits
+template<size_t Width, size_t Height>
+constexpr uint64_t make_anchor_mask(uint32_t type) {
+    uint64_t mask = 0;
+    for (uint32_t cell = 0; cell < Width * Height; cell++) {
+        if (piece_fits<Width, Height>(type, cell)) {
+            mask |= uint64_t {1} << cell;
+        }
+    }
+
+    return mask;
+}
+
+template<size_t Width, size_t Height>
+inline constexpr std::array<uint64_t, 4> anchor_masks = {
+    make_anchor_mask<Width, Height>(piece_type::green), make_anchor_mask<Width, Height>(piece_type::blue),
+    make_anchor_mask<Width, Height>(piece_type::purple), make_anchor_mask<Width, Height>(piece_type::red)
+};
+
+// Perfect ranking of the boards made up of a given set of pieces: every such board maps to a distinct integer in
+// [0, size()), and the board can be recovered from it. A board is ranked by the position of the red piece, then by
+// the positions of the purple and blue pieces (as combinations of the positions where such a piece fits), then by the
+// cells of the green pieces (as a combination of the cells left free by the other pieces). Some ranks don't
+// correspond to a board, as pieces may overlap; unrank() returns std::nullopt for those.
+template<typename Board>
+class board_ranker {
+public:
+    using key_type = typename Board::key_type;
+
+private:
+    static constexpr const std::array<uint64_t, 4> &anchor_masks = ::anchor_masks<Board::width, Board::height>;
+    static constexpr const std::array<uint64_t, 4> &piece_shapes = ::piece_shapes<Board::width>;
+
+    // Returns the lowest cell of every piece of the given type covering the cells in mask.
+    static uint64_t anchors(uint32_t type, uint64_t mask) {
+        uint64_t anchor_mask = 0;
+        while (mask) {
+            uint64_t anchor = mask & -mask;
+            anchor_mask |= anchor;
+            mask &= ~(piece_shapes[type] * anchor);
+        }
+
+        return anchor_mask;
+    }
+
+    // Returns the cells of the pieces of the given type whose lowest cells are in anchor_mask.
+    static uint64_t cells(uint32_t type, uint64_t anchor_mask) {
+        uint64_t mask = 0;
+        for (; anchor_mask; anchor_mask &= anchor_mask - 1) {
+            mask |= piece_shapes[type] * (anchor_mask & -anchor_mask);
+        }
+
+        return mask;
+    }
+
+    // Rank of the subset mask of candidates among the subsets of the same size (combinatorial number system)
+    static uint64_t combination_rank(uint64_t mask, uint64_t candidates) {
+        uint64_t rank = 0;
+        size_t k = 0;
+        for (; mask; mask &= mask - 1) {
+            rank += binomials[__builtin_popcountll(candidates & ((mask & -mask) - 1))][++k];
+        }
+
+        return rank;
+    }
+
+    static uint64_t combination_unrank(uint64_t rank, size_t k, uint64_t candidates) {
+        uint64_t mask = 0;
+        size_t n = __builtin_popcountll(candidates);
+        for (; k > 0; k--) {
+            do {
+                n--;
+            } while (binomials[n][k] > rank);
+
+            rank -= binomials[n][k];
+            uint64_t candidate = candidates;
+            for (size_t i = 0; i < n; i++) {
+                candidate &= candidate - 1;
+            }
+
+            mask |= candidate & -candidate;
+        }
+
+        return mask;
+    }
+
+    std::array<uint32_t, 4> counts = {};
+    std::array<uint64_t, 4> combination_counts = {};
+
+public:
+    explicit board_ranker(const Board &board) {
+        for (auto piece : board.pieces) {
+            counts[piece.type()]++;
+        }
+
+        uint32_t free_cells = Board::cell_count - counts[piece_type::red] * 4 - counts[piece_type::purple] * 2 -
+                              counts[piece_type::blue] * 2;
+        combination_counts[piece_type::red] = __builtin_popcountll(anchor_masks[piece_type::red]);
+        combination_counts[piece_type::purple] =
+            binomials[__builtin_popcountll(anchor_masks[piece_type::purple])][counts[piece_type::purple]];
+        combination_counts[piece_type::blue] =
+            binomials[__builtin_popcountll(anchor_masks[piece_type::blue])][counts[piece_type::blue]];
+        combination_counts[piece_type::green] = binomials[free_cells][counts[piece_type::green]];
+    }
+
+    // Number of ranks, or std::numeric_limits<uint64_t>::max() if they don't fit in 64 bits
+    uint64_t size() const {
+        uint64_t size = 1;
+        for (uint64_t count : combination_counts) {
+            if (__builtin_mul_overflow(size, count, &size)) {
+                return std::numeric_limits<uint64_t>::max();
+            }
+        }
+
+        return size;
+    }
+
+    uint64_t rank(key_type key) const {
+        uint64_t red_cells = piece_shapes[piece_type::red] << key.red();
+        uint64_t free_cells = Board::all_cells_mask & ~(red_cells | key.purple() | key.blue());
+        uint64_t rank = __builtin_popcountll(anchor_masks[piece_type::red] & ((uint64_t {1} << key.red()) - 1));
+        rank = rank * combination_counts[piece_type::purple] +
+               combination_rank(anchors(piece_type::purple, key.purple()), anchor_masks[piece_type::purple]);
+        rank = rank * combination_counts[piece_type::blue] +
+               combination_rank(anchors(piece_type::blue, key.blue()), anchor_masks[piece_type::blue]);
+        return rank * combination_counts[piece_type::green] + combination_rank(key.green(), free_cells);
+    }
+
+    std::optional<key_type> unrank(uint64_t rank) const {
+        uint64_t green_rank = rank % combination_counts[piece_type::green];
+        rank /= combination_counts[piece_type::green];
+        uint64_t blue = cells(piece_type::blue,
+                              combination_unrank(rank % combination_counts[piece_type::blue],
+                                                 counts[piece_type::blue], anchor_masks[piece_type::blue]));
+        rank /= combination_counts[piece_type::blue];
+        uint64_t purple = cells(piece_type::purple,
+                                combination_unrank(rank % combination_counts[piece_type::purple],
+                                                   counts[piece_type::purple], anchor_masks[piece_type::purple]));
+        rank /= combination_counts[piece_type::purple];
+        uint64_t red = cells(piece_type::red, combination_unrank(rank, 1, anchor_masks[piece_type::red]));
+
+        // Overlapping pieces (including pieces of the same type) cover fewer cells than expected.
+        uint64_t occupied = red | purple | blue;
+        if (static_cast<uint32_t>(__builtin_popcountll(occupied)) !=
+            counts[piece_type::red] * 4 + counts[piece_type::purple] * 2 + counts[piece_type::blue] * 2) {
+            return std::nullopt;
+        }
+
+        uint64_t green = combination_unrank(green_rank, counts[piece_type::green], Board::all_cells_mask & ~occupied);
+        using cells_type = typename key_type::cells_type;
+        return key_type(static_cast<cells_type>(green), static_cast<cells_type>(blue), static_cast<cells_type>(purple),
+                        static_cast<cells_type>(red));
+    }
+};
@@ -0,0 +1,144 @@
+#pragma once
+
+#include <array>
+#include <fstream>
+#include <string>
+#include <cerrno>
+#include <cstddef>
+#include <cstdint>
+#include <cstdio>
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "board.hpp"
+#include "state_store.hpp"
+
+// Snapshot of a breadth-first search between two layers, from which it can be resumed. The file (in native byte order)
+// consists of:
+//
+// - a checkpoint_header
+// - the packed keys of all boards (key_size bytes each, the size of the board's key type), by id
+// - the parent id of every board (uint32_t), in the same order
+// - the first id of every layer (uint32_t)
+//
+// This is the state store without its hash maps, which are rebuilt from the keys on load. The last layer is the
+// frontier the search goes on from, and the first board is the one the search started from.
+struct checkpoint_header {
+    std::array<char, 8> magic;
+    uint64_t board_count;
+    uint64_t layer_count;
+    uint16_t width;
+    uint16_t height;
+    uint32_t key_size;
+};
+
+inline constexpr std::array<char, 8> checkpoint_magic = { 'R', 'E', 'S', 'C', 'C', 'P', '0', '1' };
+
+// Writes the store to path. The file is written next to it first and renamed over it once complete, so an interrupted
+// write leaves the previous checkpoint in place. Returns false on failure.
+template<typename Board>
+bool write_checkpoint(const basic_state_store<Board> &states, const std::string &path) {
+    using key_type = typename Board::key_type;
+    checkpoint_header header = { checkpoint_magic, states.size(), states.layer_count(), Board::width, Board::height,
+                                 sizeof(key_type) };
+    std::string temporary_path = path + ".tmp";
+    std::ofstream file(temporary_path, std::ios::binary | std::ios::trunc);
+    file.write(reinterpret_cast<const char *>(&header), sizeof(header));
+    for (uint32_t id = 0; id < states.size(); id++) {
+        typename key_type::word_type key = states.key(id).bits;
+        file.write(reinterpret_cast<const char *>(&key), sizeof(key));
+    }
+
+    for (uint32_t id = 0; id < states.size(); id++) {
+        uint32_t parent = states.parent(id);
+        file.write(reinterpret_cast<const char *>(&parent), sizeof(parent));
+    }
+
+    for (size_t layer = 0; layer < states.layer_count(); layer++) {
+        uint32_t layer_begin = states.layer_begin(layer);
+        file.write(reinterpret_cast<const char *>(&layer_begin), sizeof(layer_begin));
+    }
+
+    file.close();
+    if (!file || std::rename(temporary_path.c_str(), path.c_str()) != 0) {
+        std::remove(temporary_path.c_str());
+        return false;
+    }
+
+    return true;
+}
+
+enum class checkpoint_status {
+    loaded,
+    missing,
+    invalid
+};
+
+// Replaces the contents of the store with the checkpoint at path, which is mapped into memory. The checkpoint is
+// invalid if it can't be read, wasn't written by a search from board, or holds a key that isn't a board made of the
+// same pieces.
+template<typename Board>
+checkpoint_status read_checkpoint(const Board &board, basic_state_store<Board> &states, const char *path) {
+    using state_store = basic_state_store<Board>;
+    using key_type = typename Board::key_type;
+    using word_type = typename key_type::word_type;
+    int fd = ::open(path, O_RDONLY);
+    if (fd < 0) {
+        return errno == ENOENT ? checkpoint_status::missing : checkpoint_status::invalid;
+    }
+
+    void *data = MAP_FAILED;
+    size_t size = 0;
+    struct stat file_stat;
+    if (fstat(fd, &file_stat) == 0 && static_cast<size_t>(file_stat.st_size) >= sizeof(checkpoint_header)) {
+        size = static_cast<size_t>(file_stat.st_size);
+        data = mmap(nullptr, size, PROT_READ, MAP_SHARED, fd, 0);
+    }
+
+    close(fd);
+    if (data == MAP_FAILED) {
+        return checkpoint_status::invalid;
+    }
+
+    const auto *bytes = static_cast<const unsigned char *>(data);
+    const auto *header = reinterpret_cast<const checkpoint_header *>(bytes);
+    const auto *keys = reinterpret_cast<const word_type *>(bytes + sizeof(checkpoint_header));
+    const auto *parents = reinterpret_cast<const uint32_t *>(keys + header->board_count);
+    const uint32_t *layer_begins = parents + header->board_count;
+    bool valid = header->magic == checkpoint_magic && header->width == Board::width &&
+                 header->height == Board::height && header->key_size == sizeof(key_type) &&
+                 header->board_count > 0 && header->board_count < state_store::no_parent &&
+                 header->layer_count > 0 && header->layer_count <= header->board_count + 1 &&
+                 size == sizeof(checkpoint_header) + header->board_count * (sizeof(key_type) + sizeof(uint32_t)) +
+                             header->layer_count * sizeof(uint32_t) &&
+                 keys[0] == board.key().bits && layer_begins[0] == 0;
+    for (size_t layer = 1; valid && layer < header->layer_count; layer++) {
+        valid = layer_begins[layer - 1] < layer_begins[layer] && layer_begins[layer] <= header->board_count;
+    }
+
+    if (valid) {
+        states.clear();
+        for (size_t layer = 0; valid && layer < header->layer_count; layer++) {
+            if (layer > 0) {
+                states.add_layer();
+            }
+
+            uint32_t layer_end = layer + 1 < header->layer_count ? layer_begins[layer + 1]
+                                                                 : static_cast<uint32_t>(header->board_count);
+            for (uint32_t id = layer_begins[layer]; valid && id < layer_end; id++) {
+                valid = (parents[id] < id || parents[id] == state_store::no_parent) &&
+                        Board::valid_key(key_type(keys[id]), board) && states.insert(key_type(keys[id]), parents[id]);
+            }
+        }
+
+        if (!valid) {
+            states.clear();
+        }
+    }
+
+    munmap(data, size);
+    return valid ? checkpoint_status::loaded : checkpoint_status::invalid;
+}
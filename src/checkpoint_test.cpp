@@ -0,0 +1,116 @@
+#include <array>
+#include <fstream>
+#include <iostream>
+#include <iterator>
+#include <optional>
+#include <string>
+#include <string_view>
+#include <vector>
+#include <cstddef>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+
+#include "board.hpp"
+#include "checkpoint.hpp"
+#include "layout.hpp"
+#include "state_store.hpp"
+
+// One start position per entry of supported_boards. A checkpoint of each of them and the boards one move away is
+// written, and read back whole and corrupted.
+static constexpr std::array<std::string_view, 4> test_layouts = {
+    default_layout,
+    "PRRP/PRRP/PBBP/PGGP/G__G",
+    "BBGRRP/G_GRRP/BBGPBB/PG_PG_/P_BB__",
+    "BBBBPG/RRGGP_/RRPBB_/G_P__G/BBGPP_/G__PP_"
+};
+
+static const char *const test_path = "checkpoint-test.bin";
+
+static std::string read_file(const char *path) {
+    std::ifstream file(path, std::ios::binary);
+    return std::string(std::istreambuf_iterator<char>(file), std::istreambuf_iterator<char>());
+}
+
+static void write_file(const char *path, const std::string &contents) {
+    std::ofstream file(path, std::ios::binary | std::ios::trunc);
+    file.write(contents.data(), static_cast<std::streamsize>(contents.size()));
+}
+
+// Checks that a checkpoint of the search from board is read back as it was written, and that it is invalid once the key
+// of its last board is corrupted: with any bit of the green, blue and purple masks flipped, the red piece moved off the
+// board, or a bit set above the red piece. Returns the number of checks that failed.
+template<typename Board>
+static size_t check_checkpoints(const Board &board) {
+    using state_store = basic_state_store<Board>;
+    using key_type = typename Board::key_type;
+    using word_type = typename key_type::word_type;
+    state_store states;
+    states.insert(board.key(), state_store::no_parent);
+    states.add_layer();
+    board.generate_moves([&](const Board &new_board) {
+        states.insert(new_board.key(), new_board.hash(), 0);
+    });
+
+    if (!write_checkpoint(states, test_path)) {
+        std::cerr << "Failed to write " << test_path << '\n';
+        return 1;
+    }
+
+    size_t failures = 0;
+    state_store loaded;
+    if (read_checkpoint(board, loaded, test_path) != checkpoint_status::loaded || loaded.size() != states.size() ||
+        loaded.layer_count() != states.layer_count()) {
+        std::cerr << "A checkpoint of " << states.size() << " boards wasn't read back\n";
+        failures++;
+    }
+
+    std::string contents = read_file(test_path);
+    size_t offset = sizeof(checkpoint_header) + (states.size() - 1) * sizeof(word_type);
+    word_type key;
+    std::memcpy(&key, contents.data() + offset, sizeof(key));
+    std::vector<word_type> corrupt_keys;
+    for (size_t bit = 0; bit < key_type::cell_count * 3; bit++) {
+        corrupt_keys.push_back(key ^ word_type {1} << bit);
+    }
+
+    corrupt_keys.push_back(key | ((word_type {1} << key_type::red_bits) - 1) << (key_type::cell_count * 3));
+    if (key_type::cell_count * 3 + key_type::red_bits < sizeof(word_type) * 8) {
+        corrupt_keys.push_back(key | word_type {1} << (sizeof(word_type) * 8 - 1));
+    }
+
+    for (word_type corrupt_key : corrupt_keys) {
+        std::string corrupt_contents = contents;
+        std::memcpy(corrupt_contents.data() + offset, &corrupt_key, sizeof(corrupt_key));
+        write_file(test_path, corrupt_contents);
+        if (read_checkpoint(board, loaded, test_path) != checkpoint_status::invalid || loaded.size() != 0) {
+            failures++;
+        }
+    }
+
+    if (failures > 0) {
+        std::cerr << failures << " corrupted checkpoints weren't rejected\n";
+    }
+
+    std::remove(test_path);
+    return failures;
+}
+
+int main() {
+    size_t failures = 0;
+    for (std::string_view text : test_layouts) {
+        std::optional<board_layout> layout = parse_layout(text);
+        bool supported = layout && with_board(*layout, [&](const auto &board) {
+            failures += check_checkpoints(board);
+        });
+
+        if (!supported) {
+            std::cerr << "Unsupported test layout " << text << '\n';
+            return 1;
+        }
+
+        std::cout << text << ": checkpoint checked\n";
+    }
+
+    return failures > 0 ? 1 : 0;
+}
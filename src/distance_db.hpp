@@ -0,0 +1,222 @@
+#pragma once
+
+#include <algorithm>
+#include <array>
+#include <fstream>
+#include <functional>
+#include <limits>
+#include <optional>
+#include <tuple>
+#include <vector>
+#include <cstddef>
+#include <cstdint>
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "board.hpp"
+#include "search.hpp"
+#include "state_store.hpp"
+
+// On-disk table of the number of moves needed to solve every board that can be solved, for a given set of pieces.
+// The file (in native byte order) consists of:
+//
+// - a distance_db_header
+// - the packed keys of all boards (key_size bytes each, the size of the board's key type), sorted by their hash
+// - 2^bucket_bits + 1 uint32_t bucket offsets into the keys
+// - the distance of every board (uint16_t), in the same order
+//
+// Each bucket holds the boards whose hash starts with the bucket index, so a lookup only scans a bucket with one board
+// on average.
+struct distance_db_header {
+    std::array<char, 8> magic;
+    uint64_t board_count;
+    uint32_t bucket_bits;
+    uint32_t max_distance;
+    uint16_t width;
+    uint16_t height;
+    uint32_t key_size;
+    std::array<uint32_t, 4> piece_counts; // Number of pieces of each type, by piece_type
+};
+
+inline constexpr std::array<char, 8> distance_db_magic = { 'R', 'E', 'S', 'C', 'D', 'B', '0', '3' };
+
+// Number of pieces of each type on the board, by piece_type. A database only holds boards made of the same pieces.
+template<typename Board>
+std::array<uint32_t, 4> count_piece_types(const Board &board) {
+    std::array<uint32_t, 4> counts = {};
+    for (auto piece : board.pieces) {
+        counts[piece.type()]++;
+    }
+
+    return counts;
+}
+
+// Runs a breadth-first search backward from every solved board made of the same pieces as board, and writes the
+// distance of every board reached to path. Returns the number of boards written, or std::nullopt on failure (including
+// when there are more than max_solved_boards solved boards to start from).
+template<typename Board>
+std::optional<size_t> build_distance_db(const Board &board, const char *path) {
+    using key_type = typename Board::key_type;
+    basic_state_store<Board> states;
+    if (!solution_distance_search(board, states)) {
+        return std::nullopt;
+    }
+
+    if (states.size() > 0 && states.layer(static_cast<uint32_t>(states.size() - 1)) >
+                                 std::numeric_limits<uint16_t>::max()) {
+        return std::nullopt;
+    }
+
+    std::vector<std::tuple<size_t, typename key_type::word_type, uint16_t>> boards;
+    boards.reserve(states.size());
+    for (size_t layer = 0; layer < states.layer_count(); layer++) {
+        for (uint32_t id = states.layer_begin(layer); id < states.layer_end(layer); id++) {
+            key_type key = states.key(id);
+            boards.emplace_back(std::hash<key_type>()(key), key.bits, static_cast<uint16_t>(layer));
+        }
+    }
+
+    std::sort(boards.begin(), boards.end());
+    distance_db_header header = { distance_db_magic, boards.size(), 1, 0, Board::width, Board::height,
+                                  sizeof(key_type), count_piece_types(board) };
+    while ((size_t {1} << header.bucket_bits) < boards.size()) {
+        header.bucket_bits++;
+    }
+
+    std::vector<uint32_t> offsets((size_t {1} << header.bucket_bits) + 1);
+    std::vector<typename key_type::word_type> keys;
+    std::vector<uint16_t> sorted_distances;
+    keys.reserve(boards.size());
+    sorted_distances.reserve(boards.size());
+    for (auto [hash, key, distance] : boards) {
+        offsets[(hash >> (std::numeric_limits<size_t>::digits - header.bucket_bits)) + 1]++;
+        keys.push_back(key);
+        sorted_distances.push_back(distance);
+        header.max_distance = std::max<uint32_t>(header.max_distance, distance);
+    }
+
+    for (size_t i = 1; i < offsets.size(); i++) {
+        offsets[i] += offsets[i - 1];
+    }
+
+    std::ofstream file(path, std::ios::binary | std::ios::trunc);
+    file.write(reinterpret_cast<const char *>(&header), sizeof(header));
+    file.write(reinterpret_cast<const char *>(keys.data()), keys.size() * sizeof(keys[0]));
+    file.write(reinterpret_cast<const char *>(offsets.data()), offsets.size() * sizeof(offsets[0]));
+    file.write(reinterpret_cast<const char *>(sorted_distances.data()),
+               sorted_distances.size() * sizeof(sorted_distances[0]));
+    file.close();
+    if (!file) {
+        return std::nullopt;
+    }
+
+    return boards.size();
+}
+
+// Read-only view of a distance database for boards of type Board, mapped into memory.
+template<typename Board>
+class distance_db {
+public:
+    using key_type = typename Board::key_type;
+
+private:
+    void *data = MAP_FAILED;
+    size_t size = 0;
+    const distance_db_header *header = nullptr;
+    const uint32_t *offsets = nullptr;
+    const typename key_type::word_type *keys = nullptr;
+    const uint16_t *distances = nullptr;
+
+public:
+    distance_db() = default;
+    distance_db(const distance_db &) = delete;
+    distance_db &operator=(const distance_db &) = delete;
+
+    ~distance_db() {
+        if (data != MAP_FAILED) {
+            munmap(data, size);
+        }
+    }
+
+    // Returns false if the file can't be mapped or isn't a distance database for the size and pieces of board.
+    bool open(const char *path, const Board &board) {
+        int fd = ::open(path, O_RDONLY);
+        if (fd < 0) {
+            return false;
+        }
+
+        struct stat file_stat;
+        if (fstat(fd, &file_stat) == 0 && static_cast<size_t>(file_stat.st_size) >= sizeof(distance_db_header)) {
+            size = static_cast<size_t>(file_stat.st_size);
+            data = mmap(nullptr, size, PROT_READ, MAP_SHARED, fd, 0);
+        }
+
+        close(fd);
+        if (data == MAP_FAILED) {
+            return false;
+        }
+
+        // The sizes in the header are only used once they are known to fit in the file.
+        const auto *bytes = static_cast<const unsigned char *>(data);
+        header = reinterpret_cast<const distance_db_header *>(bytes);
+        if (header->magic != distance_db_magic || header->width != Board::width || header->height != Board::height ||
+            header->key_size != sizeof(key_type) || header->piece_counts != count_piece_types(board) ||
+            header->bucket_bits == 0 ||
+            header->bucket_bits >= std::numeric_limits<uint32_t>::digits || header->board_count > size) {
+            return false;
+        }
+
+        size_t bucket_count = size_t {1} << header->bucket_bits;
+        size_t expected_size = sizeof(distance_db_header) + (bucket_count + 1) * sizeof(uint32_t) +
+                               header->board_count * (sizeof(key_type) + sizeof(uint16_t));
+        if (size != expected_size) {
+            return false;
+        }
+
+        keys = reinterpret_cast<const typename key_type::word_type *>(bytes + sizeof(distance_db_header));
+        offsets = reinterpret_cast<const uint32_t *>(keys + header->board_count);
+        distances = reinterpret_cast<const uint16_t *>(offsets + bucket_count + 1);
+
+        // Every lookup scans the keys between two offsets, which must stay within the keys.
+        return offsets[0] == 0 && offsets[bucket_count] == header->board_count &&
+               std::is_sorted(offsets, offsets + bucket_count + 1);
+    }
+
+    size_t board_count() const {
+        return header->board_count;
+    }
+
+    // Returns the number of moves needed to solve the board, or std::nullopt if it can't be solved.
+    std::optional<uint32_t> distance(key_type key) const {
+        size_t bucket = std::hash<key_type>()(key) >> (std::numeric_limits<size_t>::digits - header->bucket_bits);
+        for (uint32_t i = offsets[bucket]; i < offsets[bucket + 1]; i++) {
+            if (keys[i] == key.bits) {
+                return distances[i];
+            }
+        }
+
+        return std::nullopt;
+    }
+
+    // Returns the board after the first move of a shortest solution, or std::nullopt if the board is already solved
+    // or can't be solved.
+    std::optional<key_type> next_move(const Board &board) const {
+        std::optional<uint32_t> current_distance = distance(board.key());
+        if (!current_distance || *current_distance == 0) {
+            return std::nullopt;
+        }
+
+        std::optional<key_type> next_key;
+        board.generate_moves([&](const Board &new_board) {
+            key_type key = new_board.key();
+            if (!next_key && distance(key) == *current_distance - 1) {
+                next_key = key;
+            }
+        });
+
+        return next_key;
+    }
+};
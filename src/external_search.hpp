@@ -0,0 +1,421 @@
+#pragma once
+
+#include <algorithm>
+#include <array>
+#include <cstdio>
+#include <functional>
+#include <optional>
+#include <queue>
+#include <string>
+#include <utility>
+#include <vector>
+#include <cerrno>
+#include <cstddef>
+#include <cstdint>
+
+#include "board.hpp"
+#include "search_stats.hpp"
+
+// Files of sorted packed keys, stored as the differences between consecutive keys, in LEB128 (7 bits per byte, with
+// the high bit set on every byte but the last). Consecutive boards of a layer share most of their high bits, so this
+// takes a few bytes per board instead of the full key size. Both classes buffer their I/O, so files are only ever read
+// and written sequentially, in large blocks.
+template<typename Word>
+class key_file_writer {
+private:
+    std::FILE *file = nullptr;
+    std::vector<unsigned char> buffer;
+    Word previous = 0;
+    bool ok = true;
+
+    void flush() {
+        ok = ok && std::fwrite(buffer.data(), 1, buffer.size(), file) == buffer.size();
+        buffer.clear();
+    }
+
+public:
+    static constexpr size_t buffer_size = 1 << 16;
+
+    key_file_writer() = default;
+    key_file_writer(const key_file_writer &) = delete;
+    key_file_writer &operator=(const key_file_writer &) = delete;
+
+    ~key_file_writer() {
+        close();
+    }
+
+    bool open(const std::string &path) {
+        buffer.reserve(buffer_size);
+        file = std::fopen(path.c_str(), "wb");
+        return file;
+    }
+
+    // Keys must be written in increasing order.
+    void write(Word key) {
+        Word delta = key - previous;
+        previous = key;
+        for (; delta >= 0x80; delta >>= 7) {
+            buffer.push_back(static_cast<unsigned char>(delta | 0x80));
+        }
+
+        buffer.push_back(static_cast<unsigned char>(delta));
+        if (buffer.size() >= buffer_size - 32) {
+            flush();
+        }
+    }
+
+    // Returns false if anything failed to be written.
+    bool close() {
+        if (file) {
+            flush();
+            ok = std::fclose(file) == 0 && ok;
+            file = nullptr;
+        }
+
+        return ok;
+    }
+};
+
+template<typename Word>
+class key_file_reader {
+private:
+    std::FILE *file = nullptr;
+    std::vector<unsigned char> buffer;
+    size_t position = 0;
+    Word previous = 0;
+
+    bool read_byte(unsigned char &byte) {
+        if (position == buffer.size()) {
+            buffer.resize(key_file_writer<Word>::buffer_size);
+            buffer.resize(std::fread(buffer.data(), 1, buffer.size(), file));
+            position = 0;
+            if (buffer.empty()) {
+                return false;
+            }
+        }
+
+        byte = buffer[position++];
+        return true;
+    }
+
+public:
+    key_file_reader() = default;
+    key_file_reader(const key_file_reader &) = delete;
+    key_file_reader &operator=(const key_file_reader &) = delete;
+
+    ~key_file_reader() {
+        if (file) {
+            std::fclose(file);
+        }
+    }
+
+    bool open(const std::string &path) {
+        file = std::fopen(path.c_str(), "rb");
+        return file;
+    }
+
+    // Returns false once every key has been read.
+    bool read(Word &key) {
+        Word delta = 0;
+        unsigned char byte;
+        for (size_t shift = 0; ; shift += 7) {
+            if (!read_byte(byte)) {
+                return false;
+            }
+
+            delta |= static_cast<Word>(byte & 0x7f) << shift;
+            if (!(byte & 0x80)) {
+                break;
+            }
+        }
+
+        key = previous += delta;
+        return true;
+    }
+
+    // Returns true if the file couldn't be read to the end.
+    bool failed() const {
+        return std::ferror(file);
+    }
+};
+
+// Largest number of run files external_breadth_first_search reads at once
+inline constexpr size_t max_merged_runs = 64;
+
+// Breadth-first search that keeps the visited set on disk, for state spaces that don't fit in memory. Each layer is
+// written to directory as a sorted key file. A layer is expanded by streaming its file and collecting the new boards
+// in a buffer of buffer_size keys, which is sorted and spilled to a run file whenever it fills up. The runs are then
+// merged into the next layer, dropping the boards already in the two previous layers as they go: every move can be
+// undone, so any board reached again was last seen at most two layers ago.
+//
+// At most max_merged_runs runs are merged at once, to keep the number of open files bounded: when a layer spills more,
+// they are first merged in groups into fewer, longer runs.
+//
+// Parents aren't stored. Once a solved board is found, the solution is recovered with a backward pass over the layer
+// files, looking for a neighbor of the current board in each earlier layer. Returns the boards on a shortest solution,
+// an empty path if there is none, or std::nullopt if a file couldn't be read or written, with errno describing the
+// failure. The layer files are removed before returning.
+template<typename Board, typename Stats = null_search_stats>
+std::optional<std::vector<typename Board::key_type>> external_breadth_first_search(
+    const Board &board, const std::string &directory, size_t buffer_size, Stats &&stats = Stats()) {
+    using key_type = typename Board::key_type;
+    using word_type = typename key_type::word_type;
+
+    auto layer_path = [&](size_t depth) {
+        return directory + "/layer-" + std::to_string(depth);
+    };
+
+    auto run_path = [&](size_t index) {
+        return directory + "/run-" + std::to_string(index);
+    };
+
+    size_t layer_count = 0;
+    size_t run_count = 0;
+    auto remove_files = [&] {
+        for (size_t i = 0; i < layer_count; i++) {
+            std::remove(layer_path(i).c_str());
+        }
+
+        for (size_t i = 0; i < run_count; i++) {
+            std::remove(run_path(i).c_str());
+        }
+    };
+
+    // Merges the runs with the given indices, calling output with each distinct key in increasing order, and removes
+    // them. Returns false if a run couldn't be read.
+    auto merge_runs = [&](const std::vector<size_t> &run_indices, auto &&output) {
+        using run_head = std::pair<word_type, size_t>;
+        std::priority_queue<run_head, std::vector<run_head>, std::greater<run_head>> heads;
+        std::vector<key_file_reader<word_type>> runs(run_indices.size());
+        bool ok = true;
+        for (size_t i = 0; ok && i < runs.size(); i++) {
+            word_type key;
+            ok = runs[i].open(run_path(run_indices[i]));
+            if (ok && runs[i].read(key)) {
+                heads.emplace(key, i);
+            }
+        }
+
+        std::optional<word_type> last_key;
+        while (ok && !heads.empty()) {
+            auto [key, run_index] = heads.top();
+            heads.pop();
+            if (word_type next_key; runs[run_index].read(next_key)) {
+                heads.emplace(next_key, run_index);
+            }
+
+            if (key != last_key) {
+                last_key = key;
+                output(key);
+            }
+        }
+
+        ok = ok && std::none_of(runs.begin(), runs.end(), [](const auto &run) { return run.failed(); });
+        runs.clear();
+        for (size_t index : run_indices) {
+            std::remove(run_path(index).c_str());
+        }
+
+        return ok;
+    };
+
+    auto search = [&]() -> std::optional<std::vector<key_type>> {
+        key_file_writer<word_type> first_layer;
+        layer_count = 1;
+        if (!first_layer.open(layer_path(0))) {
+            return std::nullopt;
+        }
+
+        first_layer.write(board.key().bits);
+        if (!first_layer.close()) {
+            return std::nullopt;
+        }
+
+        if (board.solved()) {
+            return std::vector<key_type> { board.key() };
+        }
+
+        // The buffer always has room for the moves of one more board.
+        buffer_size = std::max<size_t>(buffer_size, Board::piece_count * 12 * 2);
+        std::vector<word_type> buffer;
+        buffer.reserve(buffer_size);
+        std::optional<word_type> solution;
+        uint64_t layer_size = 1;
+        uint64_t board_count = 1;
+        while (layer_size > 0 && !solution) {
+            stats.begin_layer(layer_size);
+            size_t depth = layer_count - 1;
+            size_t first_run = run_count;
+            auto spill = [&] {
+                std::sort(buffer.begin(), buffer.end());
+                buffer.erase(std::unique(buffer.begin(), buffer.end()), buffer.end());
+                key_file_writer<word_type> run;
+                if (!run.open(run_path(run_count++))) {
+                    return false;
+                }
+
+                for (word_type key : buffer) {
+                    run.write(key);
+                }
+
+                buffer.clear();
+                return run.close();
+            };
+
+            // Expand the layer into sorted runs.
+            key_file_reader<word_type> layer;
+            if (!layer.open(layer_path(depth))) {
+                return std::nullopt;
+            }
+
+            uint64_t generated = 0;
+            for (word_type key; !solution && layer.read(key); ) {
+                stats.expanded();
+                Board(key_type(key)).generate_moves([&](const Board &new_board) {
+                    generated++;
+                    if (new_board.solved()) {
+                        solution = new_board.key().bits;
+                    }
+
+                    buffer.push_back(new_board.key().bits);
+                });
+
+                if (buffer.size() + Board::piece_count * 12 > buffer_size && !spill()) {
+                    return std::nullopt;
+                }
+            }
+
+            if (layer.failed()) {
+                return std::nullopt;
+            }
+
+            if (solution) {
+                stats.generated(generated, 0);
+                stats.end_layer();
+                break;
+            }
+
+            if (!buffer.empty() && !spill()) {
+                return std::nullopt;
+            }
+
+            // Merge the runs in groups until few enough are left to be merged at once.
+            std::vector<size_t> layer_runs;
+            for (size_t i = first_run; i < run_count; i++) {
+                layer_runs.push_back(i);
+            }
+
+            while (layer_runs.size() > max_merged_runs) {
+                std::vector<size_t> merged_runs;
+                for (size_t begin = 0; begin < layer_runs.size(); begin += max_merged_runs) {
+                    std::vector<size_t> group(layer_runs.begin() + begin,
+                                              layer_runs.begin() + std::min(begin + max_merged_runs,
+                                                                            layer_runs.size()));
+                    key_file_writer<word_type> run;
+                    merged_runs.push_back(run_count);
+                    if (!run.open(run_path(run_count++)) ||
+                        !merge_runs(group, [&](word_type key) { run.write(key); }) || !run.close()) {
+                        return std::nullopt;
+                    }
+                }
+
+                layer_runs = std::move(merged_runs);
+            }
+
+            // Merge the last runs, skipping the boards of the two previous layers.
+
+            std::array<key_file_reader<word_type>, 2> previous_layers;
+            std::array<std::optional<word_type>, 2> previous_keys;
+            for (size_t i = 0; i < previous_layers.size() && i <= depth; i++) {
+                if (!previous_layers[i].open(layer_path(depth - i))) {
+                    return std::nullopt;
+                }
+
+                if (word_type key; previous_layers[i].read(key)) {
+                    previous_keys[i] = key;
+                }
+            }
+
+            key_file_writer<word_type> next_layer;
+            layer_count++;
+            if (!next_layer.open(layer_path(depth + 1))) {
+                return std::nullopt;
+            }
+
+            layer_size = 0;
+            bool merged = merge_runs(layer_runs, [&](word_type key) {
+                bool seen = false;
+                for (size_t i = 0; i < previous_layers.size(); i++) {
+                    while (previous_keys[i] && *previous_keys[i] < key) {
+                        if (word_type previous_key; previous_layers[i].read(previous_key)) {
+                            previous_keys[i] = previous_key;
+                        } else {
+                            previous_keys[i].reset();
+                        }
+                    }
+
+                    seen = seen || previous_keys[i] == key;
+                }
+
+                if (!seen) {
+                    next_layer.write(key);
+                    layer_size++;
+                }
+            });
+
+            if (!next_layer.close() || !merged) {
+                return std::nullopt;
+            }
+
+            board_count += layer_size;
+            stats.generated(generated, generated - layer_size);
+            stats.end_layer();
+        }
+
+        stats.finish(board_count);
+        if (!solution) {
+            return std::vector<key_type> {};
+        }
+
+        // Walk back from the solved board: its predecessor on a shortest path is one of its neighbors in the previous
+        // layer, which a single pass over the sorted layer file finds.
+        std::vector<key_type> path = { key_type(*solution) };
+        for (size_t depth = layer_count; depth-- > 0; ) {
+            std::vector<word_type> neighbors;
+            Board(path.back()).generate_moves([&](const Board &neighbor) {
+                neighbors.push_back(neighbor.key().bits);
+            });
+
+            std::sort(neighbors.begin(), neighbors.end());
+            key_file_reader<word_type> layer;
+            if (!layer.open(layer_path(depth))) {
+                return std::nullopt;
+            }
+
+            auto it = neighbors.begin();
+            word_type key = 0;
+            while (layer.read(key)) {
+                it = std::lower_bound(it, neighbors.end(), key);
+                if (it == neighbors.end() || *it == key) {
+                    break;
+                }
+            }
+
+            if (it == neighbors.end() || *it != key) {
+                return std::nullopt;
+            }
+
+            path.push_back(key_type(key));
+        }
+
+        std::reverse(path.begin(), path.end());
+        return path;
+    };
+
+    errno = 0;
+    std::optional<std::vector<key_type>> path = search();
+    int error = errno;
+    remove_files();
+    errno = error;
+    return path;
+}
@@ -0,0 +1,199 @@
+#include <iostream>
+#include <optional>
+#include <sstream>
+#include <string>
+#include <string_view>
+#include <thread>
+#include <type_traits>
+#include <vector>
+#include <cerrno>
+#include <csignal>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+#include "layout.hpp"
+#include "royal_escape.hpp"
+
+// Answers a single query, one of:
+//
+// - "hint LAYOUT": "moves <n> next <layout>" with the number of moves left and the board after the next move, or
+//   "moves 0" if the board is already solved
+// - "solve LAYOUT": "moves <n>" followed by the board after each move of a shortest solution
+//
+// Layouts are written on one line with rows separated by '/'. The reply is "unsolvable" if the board can't be solved,
+// and "invalid" if the query can't be parsed or the layout isn't one of the supported board types.
+static std::string answer(std::string_view query) {
+    size_t separator = query.find(' ');
+    std::string_view command = query.substr(0, separator);
+    if (separator == std::string_view::npos || (command != "hint" && command != "solve")) {
+        return "invalid";
+    }
+
+    std::optional<board_layout> layout = parse_layout(query.substr(separator + 1));
+    std::ostringstream reply;
+    bool supported = layout && with_board(*layout, [&](const auto &board) {
+        using board_type = std::decay_t<decltype(board)>;
+        if (command == "hint") {
+            if (auto hint = next_move(board)) {
+                reply << "moves " << hint->moves_left;
+                if (hint->next_board) {
+                    reply << " next " << format_layout(board_type(*hint->next_board));
+                }
+            } else {
+                reply << "unsolvable";
+            }
+        } else if (auto path = solve(board); !path.empty()) {
+            reply << "moves " << path.size() - 1;
+            for (size_t move = 1; move < path.size(); move++) {
+                reply << ' ' << format_layout(board_type(path[move]));
+            }
+        } else {
+            reply << "unsolvable";
+        }
+    });
+
+    return supported ? reply.str() : "invalid";
+}
+
+// Longest query line read from a socket client. The longest valid query is far shorter; a client sending more without
+// a newline is dropped, so that it can't grow its buffer without bound.
+static constexpr size_t max_query_length = 4096;
+
+static bool write_all(int fd, std::string_view data) {
+    while (!data.empty()) {
+        ssize_t written = write(fd, data.data(), data.size());
+        if (written < 0 && errno != EINTR) {
+            return false;
+        }
+
+        data.remove_prefix(written > 0 ? static_cast<size_t>(written) : 0);
+    }
+
+    return true;
+}
+
+// Answers the queries of one client, one line each, until it disconnects or sends a line longer than
+// max_query_length.
+static void serve_client(int fd) {
+    std::string buffer;
+    std::vector<char> chunk(4096);
+    while (true) {
+        ssize_t count = read(fd, chunk.data(), chunk.size());
+        if (count < 0 && errno == EINTR) {
+            continue;
+        }
+
+        if (count <= 0) {
+            break;
+        }
+
+        buffer.append(chunk.data(), static_cast<size_t>(count));
+        size_t line_end;
+        bool ok = true;
+        while (ok && (line_end = buffer.find('\n')) != std::string::npos) {
+            std::string_view line(buffer.data(), line_end);
+            if (!line.empty() && line.back() == '\r') {
+                line.remove_suffix(1);
+            }
+
+            ok = line.empty() || write_all(fd, answer(line) + '\n');
+            buffer.erase(0, line_end + 1);
+        }
+
+        if (!ok || buffer.size() > max_query_length) {
+            break;
+        }
+    }
+
+    close(fd);
+}
+
+// Listens on a Unix domain socket at path, answering each client on its own thread. A socket left at path by a previous
+// run is replaced, but any other file there is left alone.
+static int serve_socket(const char *path) {
+    sockaddr_un address = {};
+    address.sun_family = AF_UNIX;
+    if (std::strlen(path) >= sizeof(address.sun_path)) {
+        std::cerr << "Socket path too long: " << path << '\n';
+        return 1;
+    }
+
+    struct stat path_stat;
+    if (lstat(path, &path_stat) == 0) {
+        if (!S_ISSOCK(path_stat.st_mode)) {
+            std::cerr << "Failed to listen on " << path << ": it exists and isn't a socket\n";
+            return 1;
+        }
+
+        unlink(path);
+    }
+
+    std::strcpy(address.sun_path, path);
+    int listen_fd = socket(AF_UNIX, SOCK_STREAM, 0);
+    if (listen_fd < 0 || bind(listen_fd, reinterpret_cast<const sockaddr *>(&address), sizeof(address)) < 0 ||
+        listen(listen_fd, SOMAXCONN) < 0) {
+        std::cerr << "Failed to listen on " << path << ": " << std::strerror(errno) << '\n';
+        return 1;
+    }
+
+    // Clients that go away before reading their reply shouldn't take the daemon down with them.
+    std::signal(SIGPIPE, SIG_IGN);
+    while (true) {
+        int fd = accept(listen_fd, nullptr, nullptr);
+        if (fd < 0) {
+            if (errno == EINTR || errno == ECONNABORTED) {
+                continue;
+            }
+
+            std::cerr << "Failed to accept a connection: " << std::strerror(errno) << '\n';
+            return 1;
+        }
+
+        std::thread(serve_client, fd).detach();
+    }
+}
+
+static void print_usage(const char *name) {
+    std::cerr << "Usage: " << name << " [--socket PATH]\n"
+              << "  --socket PATH  Answer the clients of a Unix domain socket at PATH instead of standard input\n"
+              << "\n"
+              << "Queries are read one per line, and answered with one line each:\n"
+              << "  hint LAYOUT    Number of moves left and the board after the next move\n"
+              << "  solve LAYOUT   Number of moves and the board after each move of a shortest solution\n"
+              << "LAYOUT has the rows of the board separated by '/' (e.g. " << default_layout << ").\n";
+}
+
+int main(int argc, char *argv[]) {
+    const char *socket_path = nullptr;
+    for (int i = 1; i < argc; i++) {
+        std::string_view arg = argv[i];
+        if (arg == "--socket" && i + 1 < argc) {
+            socket_path = argv[++i];
+        } else {
+            print_usage(argv[0]);
+            return 2;
+        }
+    }
+
+    if (socket_path) {
+        return serve_socket(socket_path);
+    }
+
+    for (std::string line; std::getline(std::cin, line); ) {
+        if (!line.empty() && line.back() == '\r') {
+            line.pop_back();
+        }
+
+        if (!line.empty()) {
+            std::cout << answer(line) << std::endl;
+        }
+    }
+
+    return 0;
+}
@@ -0,0 +1,181 @@
+#pragma once
+
+#include <algorithm>
+#include <array>
+#include <optional>
+#include <string>
+#include <string_view>
+#include <tuple>
+#include <utility>
+#include <vector>
+#include <cassert>
+#include <cstddef>
+#include <cstdint>
+
+#include "board.hpp"
+
+// Initial board read from a text layout. Rows are given from top to bottom, separated by newlines or '/'; whitespace
+// is ignored. Each cell is one of:
+//
+// - 'G': green piece (1x1)
+// - 'B': blue piece (2x1), together with the cell to its right
+// - 'P': purple piece (1x2), together with the cell below it
+// - 'R': red piece (2x2), which must appear exactly once
+// - '_' or '.': empty cell
+//
+// Pieces are read left to right, top to bottom, so adjacent pieces of the same type are split from their top-left
+// cell (for example, "BBBB" is two blue pieces).
+struct board_layout {
+    size_t width = 0;
+    size_t height = 0;
+    std::vector<std::pair<piece_type, uint64_t>> pieces; // Type and cells of each piece, in reading order
+};
+
+// The Royal Escape board
+inline constexpr std::string_view default_layout = "BBBBG/RRPG_/RRPG_/BBBBG";
+
+// Returns std::nullopt if text isn't a valid layout.
+inline std::optional<board_layout> parse_layout(std::string_view text) {
+    std::vector<std::string> rows(1);
+    for (char c : text) {
+        if (c == '\n' || c == '/') {
+            rows.emplace_back();
+        } else if (c != ' ' && c != '\t' && c != '\r') {
+            rows.back().push_back(c);
+        }
+    }
+
+    rows.erase(std::remove_if(rows.begin(), rows.end(), [](const std::string &row) { return row.empty(); }),
+               rows.end());
+    board_layout layout;
+    layout.height = rows.size();
+    layout.width = rows.empty() ? 0 : rows[0].size();
+    if (layout.width < 2 || layout.height < 2 || layout.width * layout.height > 64 ||
+        std::any_of(rows.begin(), rows.end(), [&](const std::string &row) { return row.size() != layout.width; })) {
+        return std::nullopt;
+    }
+
+    // Offsets (row, column) of the cells of each piece type from its top-left cell
+    static constexpr std::array<std::array<std::pair<size_t, size_t>, 4>, 4> shapes = {{
+        {{ { 0, 0 }, { 0, 0 }, { 0, 0 }, { 0, 0 } }}, // piece_type::green
+        {{ { 0, 0 }, { 0, 1 }, { 0, 1 }, { 0, 1 } }}, // piece_type::blue
+        {{ { 0, 0 }, { 1, 0 }, { 1, 0 }, { 1, 0 } }}, // piece_type::purple
+        {{ { 0, 0 }, { 0, 1 }, { 1, 0 }, { 1, 1 } }}  // piece_type::red
+    }};
+
+    static constexpr std::string_view piece_type_chars = "GBPR";
+    uint64_t assigned = 0;
+    size_t red_count = 0;
+    for (size_t row = 0; row < layout.height; row++) {
+        for (size_t column = 0; column < layout.width; column++) {
+            char c = rows[row][column];
+            uint64_t cell = uint64_t {1} << ((layout.height - 1 - row) * layout.width + layout.width - 1 - column);
+            if (c == '_' || c == '.' || (assigned & cell)) {
+                continue;
+            }
+
+            size_t type = piece_type_chars.find(c);
+            if (type == std::string_view::npos) {
+                return std::nullopt;
+            }
+
+            uint64_t cells = 0;
+            for (auto [row_offset, column_offset] : shapes[type]) {
+                size_t piece_row = row + row_offset;
+                size_t piece_column = column + column_offset;
+                if (piece_row >= layout.height || piece_column >= layout.width ||
+                    rows[piece_row][piece_column] != c) {
+                    return std::nullopt;
+                }
+
+                cells |= uint64_t {1} << ((layout.height - 1 - piece_row) * layout.width + layout.width - 1 -
+                                          piece_column);
+            }
+
+            if (cells & assigned) {
+                return std::nullopt;
+            }
+
+            assigned |= cells;
+            red_count += type == piece_type::red;
+            layout.pieces.emplace_back(static_cast<piece_type>(type), cells);
+        }
+    }
+
+    if (red_count != 1) {
+        return std::nullopt;
+    }
+
+    return layout;
+}
+
+// Builds the board for a layout of Board's dimensions and piece count.
+template<typename Board>
+Board make_board(const board_layout &layout) {
+    assert(layout.width == Board::width && layout.height == Board::height &&
+           layout.pieces.size() == Board::piece_count);
+    std::vector<std::pair<piece_type, uint64_t>> pieces = layout.pieces;
+    std::stable_sort(pieces.begin(), pieces.end(), [](const auto &lhs, const auto &rhs) {
+        return lhs.first < rhs.first;
+    });
+
+    std::array<typename Board::bitboard, Board::piece_count> bitboards;
+    for (size_t i = 0; i < bitboards.size(); i++) {
+        bitboards[i] = typename Board::bitboard(pieces[i].first,
+                                                static_cast<typename Board::word_type>(pieces[i].second));
+    }
+
+    return Board(bitboards);
+}
+
+// Text layout of a board, on one line with rows separated by '/', which parse_layout reads back into the same board.
+template<typename Board>
+std::string format_layout(const Board &board) {
+    static constexpr std::string_view piece_type_chars = "GBPR";
+    std::string text;
+    for (size_t row = 0; row < Board::height; row++) {
+        if (row > 0) {
+            text.push_back('/');
+        }
+
+        for (size_t column = 0; column < Board::width; column++) {
+            size_t cell = (Board::height - 1 - row) * Board::width + Board::width - 1 - column;
+            char c = '_';
+            for (auto piece : board.pieces) {
+                if (piece.cells() >> cell & 1U) {
+                    c = piece_type_chars[piece.type()];
+                }
+            }
+
+            text.push_back(c);
+        }
+    }
+
+    return text;
+}
+
+// Boards the solver is compiled for. Each specialization gets its own copy of the move generator and searches; add one
+// here to support another board size or piece count.
+using supported_boards = std::tuple<
+    game_board,
+    basic_game_board<4, 5, 10>,
+    basic_game_board<6, 5, 14>,
+    basic_game_board<6, 6, 16>
+>;
+
+template<typename F, typename... Boards>
+bool with_board(const board_layout &layout, F &callback, std::tuple<Boards...> *) {
+    auto matches = [&](size_t width, size_t height, size_t piece_count) {
+        return layout.width == width && layout.height == height && layout.pieces.size() == piece_count;
+    };
+
+    return ((matches(Boards::width, Boards::height, Boards::piece_count) &&
+             (callback(make_board<Boards>(layout)), true)) || ...);
+}
+
+// Calls callback with the board for the layout, specialized for its size and piece count. Returns false if the
+// solver isn't compiled for such boards.
+template<typename F>
+bool with_board(const board_layout &layout, F &&callback) {
+    return with_board(layout, callback, static_cast<supported_boards *>(nullptr));
+}
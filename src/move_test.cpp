@@ -0,0 +1,130 @@
+#include <array>
+#include <iostream>
+#include <optional>
+#include <string_view>
+#include <type_traits>
+#include <vector>
+#include <cstddef>
+#include <cstdint>
+
+#include "board.hpp"
+#include "layout.hpp"
+#include "state_store.hpp"
+
+// One start position per entry of supported_boards. The boards reachable from each of them are checked.
+static constexpr std::array<std::string_view, 4> test_layouts = {
+    default_layout,
+    "PRRP/PRRP/PBBP/PGGP/G__G",
+    "BBGRRP/G_GRRP/BBGPBB/PG_PG_/P_BB__",
+    "BBBBPG/RRGGP_/RRPBB_/G_P__G/BBGPP_/G__PP_"
+};
+
+// Boards checked per layout at most, in breadth-first order: the larger boards can reach far too many to check them all
+// within the test timeout.
+static constexpr size_t max_test_boards = size_t {1} << 18;
+
+// Cells each piece of board can move to, in move table order, according to the legal move masks.
+template<typename Board>
+static std::vector<std::vector<typename Board::word_type>> masked_moves(
+    const Board &board, const std::array<uint16_t, Board::piece_count> &masks) {
+    std::vector<std::vector<typename Board::word_type>> moves(Board::piece_count);
+    for (size_t i = 0; i < Board::piece_count; i++) {
+        const auto &entry = move_table<Board>[board.pieces[i].type()][__builtin_ctzll(board.pieces[i].cells())];
+        for (size_t j = 0; j < entry.count; j++) {
+            if (masks[i] & (1U << j)) {
+                moves[i].push_back(entry.cells[j]);
+            }
+        }
+    }
+
+    return moves;
+}
+
+// Same, according to the move_piece_* methods, in the same order.
+template<typename Board>
+static std::vector<std::vector<typename Board::word_type>> method_moves(const Board &board) {
+    static constexpr std::array<bool (Board::*)(typename Board::bitboard &), 12> methods = {
+        &Board::move_piece_up_twice, &Board::move_piece_down_twice, &Board::move_piece_left_twice,
+        &Board::move_piece_right_twice, &Board::move_piece_up_left, &Board::move_piece_up_right,
+        &Board::move_piece_bottom_left, &Board::move_piece_bottom_right, &Board::move_piece_up,
+        &Board::move_piece_down, &Board::move_piece_left, &Board::move_piece_right
+    };
+
+    std::vector<std::vector<typename Board::word_type>> moves(Board::piece_count);
+    for (size_t i = 0; i < Board::piece_count; i++) {
+        for (auto method : methods) {
+            Board new_board = board;
+            if ((new_board.*method)(new_board.pieces[i])) {
+                moves[i].push_back(new_board.pieces[i].cells());
+            }
+        }
+    }
+
+    return moves;
+}
+
+// Checks the boards reachable from board: the legal move kernels the CPU supports all give the same masks, these
+// masks allow the same moves as the move_piece_* methods, and the hash of every board (built from its key, or carried
+// through a move) is the hash of its key. Returns the number of boards that failed a check.
+template<typename Board>
+static size_t check_boards(const Board &board, size_t &board_count) {
+    using state_store = basic_state_store<Board>;
+    __builtin_cpu_init();
+    bool sse4 = __builtin_cpu_supports("sse4.1");
+    bool avx2 = __builtin_cpu_supports("avx2");
+    state_store states;
+    states.insert(board.key(), state_store::no_parent);
+    size_t failures = 0;
+    for (uint32_t id = 0; id < states.size() && id < max_test_boards; id++) {
+        Board current(states.key(id));
+        std::array<uint16_t, Board::piece_count> scalar_masks;
+        std::array<uint16_t, Board::piece_count> vector_masks;
+        legal_moves_scalar(current, scalar_masks);
+        bool ok = masked_moves(current, scalar_masks) == method_moves(current) &&
+                  typename Board::key_hash()(current.key()) == current.hash();
+        if (sse4) {
+            legal_moves_sse4(current, vector_masks);
+            ok = ok && vector_masks == scalar_masks;
+        }
+
+        if (avx2) {
+            legal_moves_avx2(current, vector_masks);
+            ok = ok && vector_masks == scalar_masks;
+        }
+
+        current.generate_moves([&](const Board &new_board) {
+            ok = ok && typename Board::key_hash()(new_board.key()) == new_board.hash();
+            states.insert(new_board.key(), new_board.hash(), id);
+        });
+
+        failures += !ok;
+        board_count++;
+    }
+
+    return failures;
+}
+
+int main() {
+    size_t failures = 0;
+    for (std::string_view text : test_layouts) {
+        size_t board_count = 0;
+        std::optional<board_layout> layout = parse_layout(text);
+        bool supported = layout && with_board(*layout, [&](const auto &board) {
+            failures += check_boards(board, board_count);
+        });
+
+        if (!supported) {
+            std::cerr << "Unsupported test layout " << text << '\n';
+            return 1;
+        }
+
+        std::cout << text << ": " << board_count << " boards checked\n";
+    }
+
+    if (failures > 0) {
+        std::cerr << failures << " boards failed\n";
+        return 1;
+    }
+
+    return 0;
+}
@@ -0,0 +1,162 @@
+#include <algorithm>
+#include <array>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <optional>
+#include <thread>
+#include <vector>
+#include <cstddef>
+#include <cstdint>
+
+#include "board.hpp"
+#include "board_rank.hpp"
+#include "layout.hpp"
+#include "royal_escape.hpp"
+#include "search.hpp"
+#include "state_store.hpp"
+
+namespace {
+    // Working memory kept between calls, for one board type
+    template<typename Board>
+    struct solver_cache {
+        using piece_counts = std::array<uint32_t, 4>;
+
+        // Visited set of the last breadth-first search
+        basic_state_store<Board> states;
+
+        // Result of solution_distance_search for every set of pieces (counted by type) seen by next_move, or null if
+        // there are too many placements of these pieces to search them all
+        std::map<piece_counts, std::unique_ptr<basic_state_store<Board>>> distances;
+
+        static piece_counts count_pieces(const Board &board) {
+            piece_counts counts = {};
+            for (auto piece : board.pieces) {
+                counts[piece.type()]++;
+            }
+
+            return counts;
+        }
+    };
+
+    // Largest number of placements of a set of pieces (as counted by board_ranker) for which next_move finds the
+    // distance of every board up front. The Royal Escape pieces have about 5 million placements, of which 54k can be
+    // solved; larger boards are searched from the board on every query instead.
+    constexpr uint64_t max_tabulated_placements = uint64_t {1} << 24;
+
+    std::mutex cache_mutex;
+
+    template<typename Board>
+    solver_cache<Board> &cache() {
+        static solver_cache<Board> board_cache;
+        return board_cache;
+    }
+
+    template<typename Board>
+    std::vector<typename Board::key_type> breadth_first_search_path(const Board &board, size_t thread_count) {
+        using state_store = basic_state_store<Board>;
+        if (thread_count == 0) {
+            thread_count = std::max(std::thread::hardware_concurrency(), 1U);
+        }
+
+        state_store &states = cache<Board>().states;
+        states.clear();
+        states.insert(board.key(), state_store::no_parent);
+        uint32_t id = thread_count > 1 ? parallel_breadth_first_search(states, thread_count)
+                                       : breadth_first_search(states);
+        if (id == state_store::no_parent) {
+            return {};
+        }
+
+        return solution_path(states, id);
+    }
+}
+
+template<typename Board>
+std::vector<typename Board::key_type> solve(const Board &board, const solve_options &options) {
+    using state_store = basic_state_store<Board>;
+    std::lock_guard lock(cache_mutex);
+    solver_cache<Board> &board_cache = cache<Board>();
+
+    // Follow the distances if next_move has already found them for these pieces.
+    if (auto it = board_cache.distances.find(solver_cache<Board>::count_pieces(board));
+        it != board_cache.distances.end() && it->second) {
+        const state_store &distances = *it->second;
+        std::vector<typename Board::key_type> path;
+        for (uint32_t id = distances.find(board.key(), board.hash()); id != state_store::no_parent;
+             id = distances.parent(id)) {
+            path.push_back(distances.key(id));
+        }
+
+        return path;
+    }
+
+    switch (options.search) {
+    case search_algorithm::bidirectional:
+        return bidirectional_search(board);
+    case search_algorithm::astar:
+        return a_star_search(board);
+    case search_algorithm::idastar:
+        return ida_star_search(board);
+    case search_algorithm::bfs:
+        break;
+    }
+
+    return breadth_first_search_path(board, options.thread_count);
+}
+
+template<typename Board>
+std::optional<board_hint<typename Board::key_type>> next_move(const Board &board) {
+    using state_store = basic_state_store<Board>;
+    using key_type = typename Board::key_type;
+    std::lock_guard lock(cache_mutex);
+    auto [it, inserted] = cache<Board>().distances.try_emplace(solver_cache<Board>::count_pieces(board));
+    if (inserted && board_ranker<Board>(board).size() <= max_tabulated_placements) {
+        it->second = std::make_unique<state_store>();
+        if (!solution_distance_search(board, *it->second)) {
+            it->second.reset();
+        }
+    }
+
+    if (!it->second) {
+        std::vector<key_type> path = breadth_first_search_path(board, 1);
+        if (path.empty()) {
+            return std::nullopt;
+        }
+
+        return board_hint<key_type> { static_cast<uint32_t>(path.size() - 1),
+                                      path.size() > 1 ? std::optional<key_type>(path[1]) : std::nullopt };
+    }
+
+    const state_store &distances = *it->second;
+    uint32_t id = distances.find(board.key(), board.hash());
+    if (id == state_store::no_parent) {
+        return std::nullopt;
+    }
+
+    board_hint<key_type> hint = { static_cast<uint32_t>(distances.layer(id)), std::nullopt };
+    if (uint32_t next_id = distances.parent(id); next_id != state_store::no_parent) {
+        hint.next_board = distances.key(next_id);
+    }
+
+    return hint;
+}
+
+// One instantiation per entry of supported_boards
+template std::vector<game_board::key_type> solve(const game_board &, const solve_options &);
+template std::vector<basic_game_board<4, 5, 10>::key_type> solve(const basic_game_board<4, 5, 10> &,
+                                                                  const solve_options &);
+template std::vector<basic_game_board<6, 5, 14>::key_type> solve(const basic_game_board<6, 5, 14> &,
+                                                                  const solve_options &);
+template std::vector<basic_game_board<6, 6, 16>::key_type> solve(const basic_game_board<6, 6, 16> &,
+                                                                  const solve_options &);
+
+template std::optional<board_hint<game_board::key_type>> next_move(const game_board &);
+template std::optional<board_hint<basic_game_board<4, 5, 10>::key_type>> next_move(
+    const basic_game_board<4, 5, 10> &);
+template std::optional<board_hint<basic_game_board<6, 5, 14>::key_type>> next_move(
+    const basic_game_board<6, 5, 14> &);
+template std::optional<board_hint<basic_game_board<6, 6, 16>::key_type>> next_move(
+    const basic_game_board<6, 6, 16> &);
+
+static_assert(std::tuple_size_v<supported_boards> == 4, "Instantiate solve and next_move for every supported board");
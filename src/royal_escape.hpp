@@ -0,0 +1,45 @@
+#pragma once
+
+#include <optional>
+#include <vector>
+#include <cstddef>
+#include <cstdint>
+
+#include "board.hpp"
+
+// Interface of libroyalescape, for programs that keep solving boards for as long as they run. The library keeps its
+// working memory from one call to the next:
+//
+// - solve() reuses the visited set of the previous breadth-first search on the same board type.
+// - next_move() runs a backward search from the solved boards the first time it sees a set of pieces, and answers
+//   every later query for the same pieces (whatever their positions) with a single lookup. solve() also uses these
+//   results once they exist. Sets of pieces with too many placements for this are searched from the board instead.
+//
+// Both functions are defined for every board type in supported_boards, and can be called from any thread; calls are
+// serialized.
+
+enum class search_algorithm {
+    bfs,
+    bidirectional,
+    astar,
+    idastar
+};
+
+struct solve_options {
+    search_algorithm search = search_algorithm::bfs;
+    size_t thread_count = 1; // Threads for the breadth-first search (0 uses all available cores)
+};
+
+template<typename Key>
+struct board_hint {
+    uint32_t moves_left;           // Number of moves needed to solve the board
+    std::optional<Key> next_board; // Board after the next move of a shortest solution, unless already solved
+};
+
+// Returns the boards on a shortest solution (the board itself first), or an empty path if there is none.
+template<typename Board>
+std::vector<typename Board::key_type> solve(const Board &board, const solve_options &options = solve_options());
+
+// Returns std::nullopt if the board can't be solved.
+template<typename Board>
+std::optional<board_hint<typename Board::key_type>> next_move(const Board &board);
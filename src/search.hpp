@@ -0,0 +1,665 @@
+#pragma once
+
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <functional>
+#include <limits>
+#include <optional>
+#include <thread>
+#include <tuple>
+#include <type_traits>
+#include <vector>
+#include <cassert>
+#include <cstddef>
+#include <cstdint>
+
+#include "board.hpp"
+#include "board_rank.hpp"
+#include "search_stats.hpp"
+#include "state_store.hpp"
+
+// Runs fn(thread_index) on thread_count threads (the calling thread included) and waits for all of them to finish.
+template<typename F>
+void run_threads(size_t thread_count, F &&fn) {
+    std::vector<std::thread> threads;
+    threads.reserve(thread_count - 1);
+    for (size_t i = 1; i < thread_count; i++) {
+        threads.emplace_back(std::ref(fn), i);
+    }
+
+    fn(0);
+    for (auto &thread : threads) {
+        thread.join();
+    }
+}
+
+// Returns the boards on the path from the root of the store to the board with the given id.
+template<typename Board>
+std::vector<typename Board::key_type> solution_path(const basic_state_store<Board> &states, uint32_t id) {
+    std::vector<typename Board::key_type> path;
+    for (; id != basic_state_store<Board>::no_parent; id = states.parent(id)) {
+        path.push_back(states.key(id));
+    }
+
+    std::reverse(path.begin(), path.end());
+    return path;
+}
+
+// Calls callback with the key of every solved board made up of the same pieces as board. A callback that returns bool
+// stops the enumeration by returning false.
+template<typename Board, typename F>
+void for_each_solved_board(const Board &board, F &&callback) {
+    using word_type = typename Board::word_type;
+    std::array<uint32_t, 4> counts = {};
+    for (auto piece : board.pieces) {
+        counts[piece.type()]++;
+    }
+
+    assert(counts[piece_type::red] == 1);
+    std::array<word_type, 4> masks = {};
+    masks[piece_type::red] = Board::solution_mask;
+
+    // Larger pieces are placed first to prune dead ends early. Pieces of the same type are placed at increasing
+    // positions, so that every board is only generated once.
+    static constexpr std::array<piece_type, 3> placement_order = { piece_type::purple, piece_type::blue,
+                                                                   piece_type::green };
+    auto place_pieces = [&](auto &self, size_t order_index, uint32_t remaining, uint32_t first_cell) -> bool {
+        if (remaining == 0) {
+            if (++order_index < placement_order.size()) {
+                return self(self, order_index, counts[placement_order[order_index]], 0);
+            }
+
+            typename Board::key_type key(masks[piece_type::green], masks[piece_type::blue], masks[piece_type::purple],
+                                         masks[piece_type::red]);
+            if constexpr (std::is_same_v<decltype(callback(key)), bool>) {
+                return callback(key);
+            } else {
+                callback(key);
+                return true;
+            }
+        }
+
+        piece_type type = placement_order[order_index];
+        word_type occupied = masks[0] | masks[1] | masks[2] | masks[3];
+        for (uint32_t cell = first_cell; cell < Board::cell_count; cell++) {
+            auto cells = static_cast<word_type>(piece_shapes<Board::width>[type] << cell);
+            if (!piece_fits<Board::width, Board::height>(type, cell) || (cells & occupied)) {
+                continue;
+            }
+
+            masks[type] |= cells;
+            bool more = self(self, order_index, remaining - 1, cell + 1);
+            masks[type] &= ~cells;
+            if (!more) {
+                return false;
+            }
+        }
+
+        return true;
+    };
+
+    place_pieces(place_pieces, 0, counts[placement_order[0]], 0);
+}
+
+// Largest number of solved boards that the searches starting from all of them put in their visited set. The Royal
+// Escape pieces have 6,795 solved boards, but larger boards can have hundreds of millions.
+inline constexpr size_t max_solved_boards = size_t {1} << 22;
+
+// Number of solved boards made up of the same pieces as board, or limit + 1 if there are more than limit.
+template<typename Board>
+size_t count_solved_boards(const Board &board, size_t limit = max_solved_boards) {
+    size_t count = 0;
+    for_each_solved_board(board, [&](typename Board::key_type) {
+        return ++count <= limit;
+    });
+
+    return count;
+}
+
+// Breadth-first search backward from every solved board made of the same pieces as board, until every board that can
+// be solved has been found. The layer of each board in the store is then the number of moves needed to solve it, and
+// its parent is the board after the next move of a shortest solution. Returns false, without searching, if there are
+// more than max_solved_boards solved boards.
+template<typename Board>
+bool solution_distance_search(const Board &board, basic_state_store<Board> &states) {
+    using state_store = basic_state_store<Board>;
+    using key_type = typename Board::key_type;
+    if (count_solved_boards(board) > max_solved_boards) {
+        return false;
+    }
+
+    for_each_solved_board(board, [&](key_type key) {
+        states.insert(key, state_store::no_parent);
+    });
+
+    for (size_t layer = 0; states.layer_begin(layer) < states.size(); layer++) {
+        auto layer_end = static_cast<uint32_t>(states.size());
+        states.add_layer();
+        for (uint32_t id = states.layer_begin(layer); id < layer_end; id++) {
+            Board(states.key(id)).generate_moves([&](const Board &new_board) {
+                states.insert(new_board.key(), new_board.hash(), id);
+            });
+        }
+    }
+
+    return true;
+}
+
+// Admissible (and consistent) estimate of the number of moves needed to solve the board. The red piece moves one
+// cell at a time, so it needs at least as many moves as its Manhattan distance to the exit; every other piece that
+// covers part of the exit must also be moved out of the way at least once.
+template<typename Board>
+uint32_t moves_lower_bound(const Board &board) {
+    static constexpr uint32_t width = Board::width;
+    static constexpr uint32_t solution_cell = __builtin_ctzll(Board::solution_mask);
+    uint32_t red_cell = __builtin_ctzll(board.pieces[Board::red_index].cells());
+    uint32_t red_rows = red_cell / width > solution_cell / width ? red_cell / width - solution_cell / width
+                                                                 : solution_cell / width - red_cell / width;
+    uint32_t red_columns = red_cell % width > solution_cell % width ? red_cell % width - solution_cell % width
+                                                                    : solution_cell % width - red_cell % width;
+    uint32_t blocking_pieces = 0;
+    for (size_t i = 0; i < Board::red_index; i++) {
+        if (board.pieces[i].bits & Board::solution_mask) {
+            blocking_pieces++;
+        }
+    }
+
+    return red_rows + red_columns + blocking_pieces;
+}
+
+// Stand-in for the layer callback of the breadth-first searches, which does nothing
+struct no_layer_callback {
+    void operator()() const { }
+};
+
+// Default move_limit of the breadth-first searches
+inline constexpr uint32_t unlimited_moves = std::numeric_limits<uint32_t>::max();
+
+// Breadth-first search from the boards in the last layer of the store, which gets one more layer per depth. Returns the
+// id of the first solved board, or state_store::no_parent if no solution exists. Counters are collected layer by layer
+// into stats. layer_done() is called whenever a layer has been filled; the store can then be saved, and the search
+// resumed from it later.
+//
+// Boards that moves_lower_bound shows can't be solved within move_limit moves of the first board are left out. None of
+// them is on a shortest solution if there is a solution of at most move_limit moves, which is then still found.
+template<typename Board, typename Stats = null_search_stats, typename LayerDone = no_layer_callback>
+uint32_t breadth_first_search(basic_state_store<Board> &states, Stats &&stats = Stats(),
+                              LayerDone &&layer_done = LayerDone(), uint32_t move_limit = unlimited_moves) {
+    // Boards are appended to the store in breadth-first order, so walking a layer by id visits it in queue order.
+    for (size_t layer = states.layer_count() - 1; states.layer_begin(layer) < states.size(); layer++) {
+        auto layer_end = static_cast<uint32_t>(states.size());
+        stats.begin_layer(layer_end - states.layer_begin(layer));
+        states.add_layer();
+        for (uint32_t id = states.layer_begin(layer); id < layer_end; id++) {
+            Board board(states.key(id));
+            if (board.solved()) {
+                stats.end_layer();
+                return id;
+            }
+
+            stats.expanded();
+            board.generate_moves([&](const Board &new_board) {
+                if (move_limit != unlimited_moves && layer + 1 + moves_lower_bound(new_board) > move_limit) {
+                    stats.generated(1, 0);
+                    stats.pruned(1);
+                } else {
+                    stats.generated(1, !states.insert(new_board.key(), new_board.hash(), id));
+                }
+            });
+        }
+
+        stats.end_layer();
+        layer_done();
+    }
+
+    return basic_state_store<Board>::no_parent;
+}
+
+// Version of breadth_first_search that doesn't hash boards: boards are identified by their rank, so the visited set is
+// a bitset and the parents are kept in a flat array, both indexed by rank. The queue holds the keys of the visited
+// boards in breadth-first order. Returns the boards on the first solution found, or an empty path if there is none.
+// The number of ranks must fit in a 32-bit id.
+template<typename Board>
+std::vector<typename Board::key_type> ranked_breadth_first_search(const Board &board) {
+    using key_type = typename Board::key_type;
+    static constexpr uint32_t no_parent = basic_state_store<Board>::no_parent;
+    board_ranker<Board> ranker(board);
+    assert(ranker.size() <= no_parent);
+    std::vector<uint64_t> visited((ranker.size() + 63) / 64);
+    std::vector<uint32_t> parents(ranker.size());
+    std::vector<key_type> queue;
+    auto visit = [&](key_type key, uint32_t parent) {
+        auto rank = static_cast<uint32_t>(ranker.rank(key));
+        uint64_t bit = uint64_t {1} << (rank % 64);
+        if (!(visited[rank / 64] & bit)) {
+            visited[rank / 64] |= bit;
+            parents[rank] = parent;
+            queue.push_back(key);
+        }
+    };
+
+    visit(board.key(), no_parent);
+    for (size_t i = 0; i < queue.size(); i++) {
+        Board queued_board(queue[i]);
+        auto rank = static_cast<uint32_t>(ranker.rank(queue[i]));
+        if (queued_board.solved()) {
+            std::vector<key_type> path;
+            for (; rank != no_parent; rank = parents[rank]) {
+                path.push_back(*ranker.unrank(rank));
+            }
+
+            std::reverse(path.begin(), path.end());
+            return path;
+        }
+
+        queued_board.generate_moves([&](const Board &new_board) {
+            visit(new_board.key(), rank);
+        });
+    }
+
+    return {};
+}
+
+// Level-synchronous version of breadth_first_search. Each layer is expanded by thread_count threads, which only look
+// up earlier layers in the store; the new boards are then deduplicated and inserted one shard per thread. New boards
+// get the same ids as in the sequential search (ordered by parent, then by generation order), so the solution found
+// does not depend on the number of threads. Counters are collected layer by layer into stats, and layer_done() and
+// move_limit work as for breadth_first_search.
+template<typename Board, typename Stats = null_search_stats, typename LayerDone = no_layer_callback>
+uint32_t parallel_breadth_first_search(basic_state_store<Board> &states, size_t thread_count,
+                                       Stats &&stats = Stats(), LayerDone &&layer_done = LayerDone(),
+                                       uint32_t move_limit = unlimited_moves) {
+    using state_store = basic_state_store<Board>;
+    using key_type = typename Board::key_type;
+    struct candidate {
+        key_type key;
+        size_t hash;
+        uint32_t parent;
+        uint32_t move; // Index of the move in the parent's generate_moves order
+    };
+
+    static constexpr size_t chunk_size = 256;
+    static constexpr size_t max_moves = Board::piece_count * piece_moves<uint32_t>::max_count;
+    using move_set = std::array<uint64_t, (max_moves + 63) / 64>;
+
+    std::vector<std::array<std::vector<candidate>, state_store::shard_count>> candidates(thread_count);
+    // Boards expanded, generated and pruned by each thread
+    std::vector<std::array<uint64_t, 3>> thread_counts(thread_count);
+    std::array<std::vector<candidate>, state_store::shard_count> new_boards;
+    std::vector<move_set> new_board_moves;
+    std::vector<size_t> offsets;
+
+    for (size_t layer = states.layer_count() - 1; states.layer_begin(layer) < states.size(); layer++) {
+        size_t layer_begin = states.layer_begin(layer);
+        size_t layer_end = states.size();
+        stats.begin_layer(layer_end - layer_begin);
+        std::atomic<size_t> next_chunk {layer_begin};
+        std::atomic<uint32_t> solution {state_store::no_parent};
+        run_threads(thread_count, [&](size_t thread_index) {
+            auto &thread_candidates = candidates[thread_index];
+            uint64_t expanded = 0;
+            uint64_t generated = 0;
+            uint64_t pruned = 0;
+            for (size_t begin; (begin = next_chunk.fetch_add(chunk_size)) < layer_end; ) {
+                auto end = static_cast<uint32_t>(std::min(begin + chunk_size, layer_end));
+                for (auto id = static_cast<uint32_t>(begin); id < end; id++) {
+                    Board board(states.key(id));
+                    if (board.solved()) {
+                        // Keep the lowest id, which is the one the sequential search stops at.
+                        uint32_t current = solution.load();
+                        while (id < current && !solution.compare_exchange_weak(current, id)) { }
+                        continue;
+                    }
+
+                    uint32_t move = 0;
+                    expanded++;
+                    board.generate_moves([&](const Board &new_board) {
+                        key_type key = new_board.key();
+                        size_t hash = new_board.hash();
+                        if (move_limit != unlimited_moves && layer + 1 + moves_lower_bound(new_board) > move_limit) {
+                            pruned++;
+                        } else if (!states.contains(key, hash)) {
+                            thread_candidates[state_store::shard_index(hash)].push_back({ key, hash, id, move });
+                        }
+
+                        move++;
+                    });
+
+                    generated += move;
+                }
+            }
+
+            thread_counts[thread_index] = { expanded, generated, pruned };
+        });
+
+        uint64_t layer_expanded = 0;
+        uint64_t layer_generated = 0;
+        uint64_t layer_pruned = 0;
+        for (auto [expanded, generated, pruned] : thread_counts) {
+            layer_expanded += expanded;
+            layer_generated += generated;
+            layer_pruned += pruned;
+        }
+
+        stats.expanded(layer_expanded);
+        if (solution != state_store::no_parent) {
+            stats.end_layer();
+            return solution;
+        }
+
+        // Deduplicate the new boards, keeping the first parent and move that reached each of them. The id map
+        // temporarily points into new_boards until the final ids are known.
+        new_board_moves.assign(layer_end - layer_begin, move_set {});
+        std::atomic<size_t> next_shard {0};
+        run_threads(thread_count, [&](size_t) {
+            for (size_t shard; (shard = next_shard++) < state_store::shard_count; ) {
+                typename state_store::id_map &ids = states.shard(shard);
+                auto &shard_boards = new_boards[shard];
+                shard_boards.clear();
+                for (auto &thread_candidates : candidates) {
+                    for (const candidate &new_board : thread_candidates[shard]) {
+                        auto it = ids.find(new_board.key, new_board.hash);
+                        if (it == ids.end()) {
+                            ids.try_emplace(new_board.key, static_cast<uint32_t>(shard_boards.size()));
+                            shard_boards.push_back(new_board);
+                        } else if (candidate &first = shard_boards[it->second];
+                                   std::tie(new_board.parent, new_board.move) < std::tie(first.parent, first.move)) {
+                            first = new_board;
+                        }
+                    }
+
+                    thread_candidates[shard].clear();
+                }
+
+                for (const candidate &new_board : shard_boards) {
+                    __atomic_fetch_or(&new_board_moves[new_board.parent - layer_begin][new_board.move / 64],
+                                      uint64_t {1} << (new_board.move % 64), __ATOMIC_RELAXED);
+                }
+            }
+        });
+
+        offsets.resize(new_board_moves.size());
+        size_t new_layer_size = 0;
+        for (size_t i = 0; i < new_board_moves.size(); i++) {
+            offsets[i] = new_layer_size;
+            for (uint64_t moves : new_board_moves[i]) {
+                new_layer_size += __builtin_popcountll(moves);
+            }
+        }
+
+        // Assign the final ids: the position of a new board in the layer is given by the number of new boards
+        // reached from earlier parents, plus those reached by earlier moves of the same parent.
+        states.add_layer();
+        states.resize(layer_end + new_layer_size);
+        next_shard = 0;
+        run_threads(thread_count, [&](size_t) {
+            for (size_t shard; (shard = next_shard++) < state_store::shard_count; ) {
+                for (const candidate &new_board : new_boards[shard]) {
+                    const move_set &moves = new_board_moves[new_board.parent - layer_begin];
+                    size_t index = offsets[new_board.parent - layer_begin];
+                    for (size_t i = 0; i < new_board.move / 64; i++) {
+                        index += __builtin_popcountll(moves[i]);
+                    }
+
+                    index += __builtin_popcountll(moves[new_board.move / 64] &
+                                                  ((uint64_t {1} << (new_board.move % 64)) - 1));
+                    auto id = static_cast<uint32_t>(layer_end + index);
+                    states.assign(id, new_board.key, new_board.parent);
+                    states.shard(shard).find(new_board.key, new_board.hash).value() = id;
+                }
+            }
+        });
+
+        stats.generated(layer_generated, layer_generated - layer_pruned - new_layer_size);
+        stats.pruned(layer_pruned);
+        stats.end_layer();
+        layer_done();
+    }
+
+    return state_store::no_parent;
+}
+
+// Bidirectional breadth-first search, from board and from every solved board at once. Moves are reversible, so the
+// backward search uses the same move generator. Each step expands a whole layer of the side with the smaller
+// frontier; once both sides have reached the same board, the two halves are joined into a shortest solution. Returns
+// the boards on that solution, or an empty path if there is none.
+//
+// With more than max_solved_boards solved boards, the backward search would start from more boards than the forward
+// search is likely to ever reach, so a plain breadth-first search from board is run instead.
+template<typename Board>
+std::vector<typename Board::key_type> bidirectional_search(const Board &board) {
+    using state_store = basic_state_store<Board>;
+    using key_type = typename Board::key_type;
+    std::array<state_store, 2> sides; // Forward and backward
+    sides[0].insert(board.key(), state_store::no_parent);
+    if (count_solved_boards(board) > max_solved_boards) {
+        uint32_t id = breadth_first_search(sides[0]);
+        return id != state_store::no_parent ? solution_path(sides[0], id) : std::vector<key_type> {};
+    }
+
+    for_each_solved_board(board, [&](key_type key) {
+        sides[1].insert(key, state_store::no_parent);
+    });
+
+    if (uint32_t id = sides[1].find(board.key()); id != state_store::no_parent) {
+        return { sides[1].key(id) };
+    }
+
+    while (true) {
+        std::array<size_t, 2> frontier_sizes;
+        for (size_t i = 0; i < sides.size(); i++) {
+            frontier_sizes[i] = sides[i].size() - sides[i].layer_begin(sides[i].layer_count() - 1);
+        }
+
+        // If either side runs out of boards, it has visited every board connected to its roots.
+        if (frontier_sizes[0] == 0 || frontier_sizes[1] == 0) {
+            return {};
+        }
+
+        size_t side_index = frontier_sizes[0] <= frontier_sizes[1] ? 0 : 1;
+        state_store &states = sides[side_index];
+        const state_store &other_states = sides[1 - side_index];
+        uint32_t layer_begin = states.layer_begin(states.layer_count() - 1);
+        auto layer_end = static_cast<uint32_t>(states.size());
+        uint32_t meeting_parent = state_store::no_parent;
+        uint32_t meeting_id = state_store::no_parent;
+        states.add_layer();
+        for (uint32_t id = layer_begin; id < layer_end && meeting_id == state_store::no_parent; id++) {
+            Board(states.key(id)).generate_moves([&](const Board &new_board) {
+                if (meeting_id != state_store::no_parent) {
+                    return;
+                }
+
+                // Nothing was reachable from both sides before this layer, so the first board that is found here
+                // already lies on a shortest solution.
+                key_type key = new_board.key();
+                if (uint32_t other_id = other_states.find(key, new_board.hash()); other_id != state_store::no_parent) {
+                    meeting_parent = id;
+                    meeting_id = other_id;
+                } else {
+                    states.insert(key, new_board.hash(), id);
+                }
+            });
+        }
+
+        if (meeting_id != state_store::no_parent) {
+            std::vector<key_type> path = solution_path(states, meeting_parent);
+            for (uint32_t id = meeting_id; id != state_store::no_parent; id = other_states.parent(id)) {
+                path.push_back(other_states.key(id));
+            }
+
+            if (side_index == 1) {
+                std::reverse(path.begin(), path.end());
+            }
+
+            return path;
+        }
+    }
+}
+
+// A* search using moves_lower_bound. Open boards are kept in one bucket per estimated solution length, and each
+// bucket is used as a stack so that deeper boards are expanded first. Returns the boards on a shortest solution, or
+// an empty path if there is none.
+template<typename Board>
+std::vector<typename Board::key_type> a_star_search(const Board &board) {
+    using state_store = basic_state_store<Board>;
+    state_store states;
+    std::vector<uint32_t> depths;
+    std::vector<std::vector<uint32_t>> buckets;
+    auto push = [&](uint32_t id, size_t estimate) {
+        if (estimate >= buckets.size()) {
+            buckets.resize(estimate + 1);
+        }
+
+        buckets[estimate].push_back(id);
+    };
+
+    states.insert(board.key(), state_store::no_parent);
+    depths.push_back(0);
+    push(0, moves_lower_bound(board));
+    for (size_t estimate = 0; estimate < buckets.size(); estimate++) {
+        while (!buckets[estimate].empty()) {
+            uint32_t id = buckets[estimate].back();
+            buckets[estimate].pop_back();
+            Board open_board(states.key(id));
+            uint32_t depth = depths[id];
+
+            // Skip entries left behind when a shorter path to the board was found.
+            if (depth + moves_lower_bound(open_board) != estimate) {
+                continue;
+            }
+
+            if (open_board.solved()) {
+                return solution_path(states, id);
+            }
+
+            open_board.generate_moves([&](const Board &new_board) {
+                typename Board::key_type key = new_board.key();
+                uint32_t new_id;
+                if (states.insert(key, new_board.hash(), id)) {
+                    new_id = static_cast<uint32_t>(states.size() - 1);
+                    depths.push_back(depth + 1);
+                } else if (new_id = states.find(key, new_board.hash()); depth + 1 < depths[new_id]) {
+                    states.assign(new_id, key, id);
+                    depths[new_id] = depth + 1;
+                } else {
+                    return;
+                }
+
+                push(new_id, depth + 1 + moves_lower_bound(new_board));
+            });
+        }
+    }
+
+    return {};
+}
+
+// Number of moves of some solution of board, or std::nullopt if it can't be solved, for the move_limit of the
+// breadth-first searches. The solution is found by a weighted A* search, which orders boards by their depth plus weight
+// times moves_lower_bound and never reopens them: it gives up on finding the shortest solution to look at far fewer
+// boards than the breadth-first search.
+template<typename Board>
+std::optional<uint32_t> solution_length_upper_bound(const Board &board, uint32_t weight = 2) {
+    using state_store = basic_state_store<Board>;
+    state_store states;
+    std::vector<uint32_t> depths;
+    std::vector<std::vector<uint32_t>> buckets;
+    auto push = [&](uint32_t id, size_t estimate) {
+        if (estimate >= buckets.size()) {
+            buckets.resize(estimate + 1);
+        }
+
+        buckets[estimate].push_back(id);
+    };
+
+    states.insert(board.key(), state_store::no_parent);
+    depths.push_back(0);
+    push(0, weight * moves_lower_bound(board));
+    for (size_t estimate = 0; estimate < buckets.size(); estimate++) {
+        while (!buckets[estimate].empty()) {
+            uint32_t id = buckets[estimate].back();
+            buckets[estimate].pop_back();
+            Board open_board(states.key(id));
+            if (open_board.solved()) {
+                return depths[id];
+            }
+
+            // The weighted estimate can decrease along a path; such boards go into the current bucket.
+            open_board.generate_moves([&](const Board &new_board) {
+                if (states.insert(new_board.key(), new_board.hash(), id)) {
+                    depths.push_back(depths[id] + 1);
+                    push(static_cast<uint32_t>(states.size() - 1),
+                         std::max<size_t>(estimate, depths[id] + 1 + weight * moves_lower_bound(new_board)));
+                }
+            });
+        }
+    }
+
+    return std::nullopt;
+}
+
+// Iterative deepening A* search using moves_lower_bound. Memory use is bounded by the transposition table, which
+// holds 2^table_bits entries and is used to cut off boards that were already reached with fewer moves during the
+// current iteration. Returns the boards on a shortest solution, or an empty path if there is none.
+template<typename Board>
+std::vector<typename Board::key_type> ida_star_search(const Board &board, size_t table_bits = 16) {
+    using key_type = typename Board::key_type;
+    struct table_entry {
+        key_type key {0};
+        uint32_t depth = 0;
+        uint32_t iteration = 0;
+    };
+
+    static constexpr uint32_t unbounded = std::numeric_limits<uint32_t>::max();
+    std::vector<table_entry> table(size_t {1} << table_bits);
+    std::vector<key_type> path;
+    uint32_t iteration = 0;
+    uint32_t bound = moves_lower_bound(board);
+    uint32_t next_bound;
+
+    auto search = [&](auto &self, const Board &search_board, uint32_t depth) -> bool {
+        uint32_t estimate = depth + moves_lower_bound(search_board);
+        if (estimate > bound) {
+            next_bound = std::min(next_bound, estimate);
+            return false;
+        }
+
+        key_type key = search_board.key();
+        table_entry &entry = table[std::hash<key_type>()(key) & (table.size() - 1)];
+        if (entry.key == key && entry.iteration == iteration && entry.depth <= depth) {
+            return false;
+        }
+
+        path.push_back(key);
+        if (search_board.solved()) {
+            return true;
+        }
+
+        entry = { key, depth, iteration };
+        bool found = false;
+        search_board.generate_moves([&](const Board &new_board) {
+            found = found || self(self, new_board, depth + 1);
+        });
+
+        if (!found) {
+            path.pop_back();
+        }
+
+        return found;
+    };
+
+    while (true) {
+        iteration++;
+        next_bound = unbounded;
+        if (search(search, board, 0)) {
+            return path;
+        }
+
+        if (next_bound == unbounded) {
+            return {};
+        }
+
+        bound = next_bound;
+    }
+}
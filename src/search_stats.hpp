@@ -0,0 +1,198 @@
+#pragma once
+
+#include <algorithm>
+#include <chrono>
+#include <functional>
+#include <ostream>
+#include <vector>
+#include <cstddef>
+#include <cstdint>
+
+#include <sys/resource.h>
+
+// Peak resident set size of the process so far, in KB
+inline long peak_rss_kb() {
+    struct rusage usage;
+    getrusage(RUSAGE_SELF, &usage);
+    return usage.ru_maxrss;
+}
+
+// Probe length of every board in a robin-map (the number of buckets a lookup of the board visits): the distance from
+// its ideal bucket to the bucket it is stored in, plus one. The map doesn't expose bucket positions, but it iterates
+// in bucket order and its robin hood layout is canonical: every board is stored in its ideal bucket, or right after
+// the previous board if that bucket is taken. Replaying that rule twice around the table recovers every position once
+// the first empty bucket is passed. Calls callback with each probe length.
+template<typename Map, typename F>
+void for_each_probe_length(const Map &map, F &&callback) {
+    size_t bucket_count = map.bucket_count();
+    if (map.empty()) {
+        return;
+    }
+
+    std::vector<size_t> ideal_buckets;
+    ideal_buckets.reserve(map.size());
+    for (const auto &entry : map) {
+        ideal_buckets.push_back(map.hash_function()(entry.first) & (bucket_count - 1));
+    }
+
+    size_t position = ideal_buckets[0] + bucket_count - 1;
+    for (size_t lap = 0; lap < 2; lap++) {
+        for (size_t ideal_bucket : ideal_buckets) {
+            // Boards are never displaced by more than half the table, so an ideal bucket up to half the table ahead of
+            // the next free position means that position is free.
+            size_t next = (position + 1) % bucket_count;
+            size_t ahead = (ideal_bucket + bucket_count - next) % bucket_count;
+            position = ahead < bucket_count / 2 ? ideal_bucket : next;
+            if (lap == 1) {
+                callback((position + bucket_count - ideal_bucket) % bucket_count + 1);
+            }
+        }
+    }
+}
+
+// Counters collected by the breadth-first searches for --stats, layer by layer. A progress line is written every
+// progress_interval while the search runs, and write_json() writes everything once it is done.
+class search_stats {
+public:
+    struct layer_stats {
+        uint64_t frontier = 0;   // Boards in the layer
+        uint64_t expanded = 0;   // Boards whose moves were generated
+        uint64_t generated = 0;  // Boards reached by these moves
+        uint64_t duplicates = 0; // Generated boards that had already been discovered
+        uint64_t pruned = 0;     // Generated boards left out because they can't be on a short enough solution
+        double seconds = 0;
+    };
+
+    static constexpr std::chrono::seconds progress_interval {1};
+
+private:
+    using clock = std::chrono::steady_clock;
+
+    std::ostream *progress;
+    size_t first_depth; // Depth of the first layer, for searches resumed from a checkpoint
+    std::vector<layer_stats> layers;
+    clock::time_point start = clock::now();
+    clock::time_point layer_start;
+    clock::time_point last_progress = start;
+    uint64_t boards = 0;
+    double seconds = 0;
+    double load_factor = 0;
+    double mean_probe_length = 0;
+    size_t max_probe_length = 0;
+    long peak_rss = 0;
+
+    void print_progress(clock::time_point now) {
+        last_progress = now;
+        std::chrono::duration<double> elapsed = now - start;
+        uint64_t expanded = 0;
+        for (const layer_stats &layer : layers) {
+            expanded += layer.expanded;
+        }
+
+        *progress << "depth " << first_depth + layers.size() - 1 << ": " << expanded << " boards expanded in "
+                  << elapsed.count() << " s (" << static_cast<uint64_t>(expanded / elapsed.count())
+                  << " boards/s), peak RSS " << peak_rss_kb() / 1024 << " MB" << std::endl;
+    }
+
+public:
+    // Progress lines are written to progress, if given. Layers are numbered from first_depth.
+    explicit search_stats(std::ostream *progress = nullptr, size_t first_depth = 0)
+      : progress {progress}, first_depth {first_depth} { }
+
+    void begin_layer(uint64_t frontier) {
+        layers.emplace_back().frontier = frontier;
+        layer_start = clock::now();
+    }
+
+    void end_layer() {
+        auto now = clock::now();
+        layers.back().seconds = std::chrono::duration<double>(now - layer_start).count();
+        if (progress && now - last_progress >= progress_interval) {
+            print_progress(now);
+        }
+    }
+
+    void expanded(uint64_t count = 1) {
+        uint64_t &expanded = layers.back().expanded;
+        expanded += count;
+
+        // Only look at the clock every so often, as it is much slower than expanding a board.
+        if (progress && expanded % 65536 < count) {
+            if (auto now = clock::now(); now - last_progress >= progress_interval) {
+                print_progress(now);
+            }
+        }
+    }
+
+    void generated(uint64_t count, uint64_t duplicates) {
+        layers.back().generated += count;
+        layers.back().duplicates += duplicates;
+    }
+
+    void pruned(uint64_t count) {
+        layers.back().pruned += count;
+    }
+
+    // Records the number of boards discovered, once the search is done. Searches that don't keep a state store call
+    // this themselves.
+    void finish(uint64_t board_count) {
+        seconds = std::chrono::duration<double>(clock::now() - start).count();
+        boards = board_count;
+        peak_rss = peak_rss_kb();
+    }
+
+    // Same, for searches that keep their visited set in a state store, whose hash maps are also looked at.
+    template<typename Store>
+    void finish(Store &states) {
+        finish(states.size());
+        size_t bucket_count = 0;
+        size_t probe_length_sum = 0;
+        for (size_t i = 0; i < Store::shard_count; i++) {
+            const auto &ids = states.shard(i);
+            bucket_count += ids.bucket_count();
+            for_each_probe_length(ids, [&](size_t probe_length) {
+                probe_length_sum += probe_length;
+                max_probe_length = std::max(max_probe_length, probe_length);
+            });
+        }
+
+        load_factor = bucket_count ? static_cast<double>(boards) / bucket_count : 0;
+        mean_probe_length = boards ? static_cast<double>(probe_length_sum) / boards : 0;
+    }
+
+    void write_json(std::ostream &os) const {
+        layer_stats total;
+        for (const layer_stats &layer : layers) {
+            total.expanded += layer.expanded;
+            total.generated += layer.generated;
+            total.duplicates += layer.duplicates;
+            total.pruned += layer.pruned;
+        }
+
+        os << "{\"seconds\":" << seconds << ",\"boards\":" << boards << ",\"expanded\":" << total.expanded
+           << ",\"generated\":" << total.generated << ",\"duplicates\":" << total.duplicates
+           << ",\"pruned\":" << total.pruned
+           << ",\"duplicate_rate\":" << (total.generated ? static_cast<double>(total.duplicates) / total.generated : 0)
+           << ",\"load_factor\":" << load_factor << ",\"mean_probe_length\":" << mean_probe_length
+           << ",\"max_probe_length\":" << max_probe_length << ",\"peak_rss_kb\":" << peak_rss << ",\"layers\":[";
+        for (size_t i = 0; i < layers.size(); i++) {
+            const layer_stats &layer = layers[i];
+            os << (i ? "," : "") << "{\"depth\":" << first_depth + i << ",\"frontier\":" << layer.frontier
+               << ",\"expanded\":" << layer.expanded << ",\"generated\":" << layer.generated
+               << ",\"duplicates\":" << layer.duplicates << ",\"pruned\":" << layer.pruned
+               << ",\"seconds\":" << layer.seconds << '}';
+        }
+
+        os << "]}\n";
+    }
+};
+
+// Stand-in for search_stats that collects nothing, for searches run without --stats
+struct null_search_stats {
+    void begin_layer(uint64_t) { }
+    void end_layer() { }
+    void expanded(uint64_t = 1) { }
+    void generated(uint64_t, uint64_t) { }
+    void pruned(uint64_t) { }
+    void finish(uint64_t) { }
+};
@@ -0,0 +1,172 @@
+#pragma once
+
+#include <algorithm>
+#include <limits>
+#include <random>
+#include <vector>
+#include <cstddef>
+#include <cstdint>
+
+#include "board.hpp"
+#include "state_store.hpp"
+
+// Every shortest solution of a board, found with a single breadth-first search that counts the shortest paths to each
+// board it discovers: the count of a board is the sum of the counts of its neighbors in the previous layer. The search
+// stops at the first layer holding a solved board, without expanding it, so it costs no more than finding one
+// solution. The solutions themselves are never stored; they are rebuilt on demand by walking back from the solved
+// boards through the neighbors in each previous layer, which are exactly the boards a shortest path can come from.
+//
+// Counts saturate at the largest uint64_t, in which case sampling is no longer uniform.
+template<typename Board>
+class shortest_solutions {
+public:
+    using key_type = typename Board::key_type;
+    using state_store = basic_state_store<Board>;
+
+private:
+    state_store states;
+    std::vector<uint64_t> counts;      // Number of shortest paths to each board, by id
+    std::vector<uint32_t> solved_ids;  // Solved boards of the last layer
+    uint64_t solution_count = 0;
+    uint32_t move_count = 0;
+
+    static uint64_t add_counts(uint64_t lhs, uint64_t rhs) {
+        uint64_t sum;
+        return __builtin_add_overflow(lhs, rhs, &sum) ? std::numeric_limits<uint64_t>::max() : sum;
+    }
+
+    // Calls callback with the id of every neighbor of the board with the given id that is in the previous layer.
+    template<typename F>
+    void for_each_predecessor(uint32_t id, uint32_t layer, F &&callback) const {
+        Board(states.key(id)).generate_moves([&](const Board &neighbor) {
+            uint32_t neighbor_id = states.find(neighbor.key(), neighbor.hash());
+            if (neighbor_id >= states.layer_begin(layer - 1) && neighbor_id < states.layer_end(layer - 1)) {
+                callback(neighbor_id);
+            }
+        });
+    }
+
+    // Walks back from the board with the given id in the given layer, filling path[0, layer], and calls callback with
+    // every complete path. Returns false once callback does.
+    template<typename F>
+    bool enumerate(uint32_t id, uint32_t layer, std::vector<key_type> &path, F &callback) const {
+        path[layer] = states.key(id);
+        if (layer == 0) {
+            return callback(static_cast<const std::vector<key_type> &>(path));
+        }
+
+        std::vector<uint32_t> predecessors;
+        for_each_predecessor(id, layer, [&](uint32_t predecessor) {
+            predecessors.push_back(predecessor);
+        });
+
+        return std::all_of(predecessors.begin(), predecessors.end(), [&](uint32_t predecessor) {
+            return enumerate(predecessor, layer - 1, path, callback);
+        });
+    }
+
+public:
+    explicit shortest_solutions(const Board &board) {
+        states.insert(board.key(), state_store::no_parent);
+        counts.push_back(1);
+        for (uint32_t layer = 0; states.layer_begin(layer) < states.size(); layer++) {
+            auto layer_end = static_cast<uint32_t>(states.size());
+            for (uint32_t id = states.layer_begin(layer); id < layer_end; id++) {
+                if (Board(states.key(id)).solved()) {
+                    solved_ids.push_back(id);
+                    solution_count = add_counts(solution_count, counts[id]);
+                }
+            }
+
+            if (!solved_ids.empty()) {
+                move_count = layer;
+                return;
+            }
+
+            states.add_layer();
+            for (uint32_t id = states.layer_begin(layer); id < layer_end; id++) {
+                Board(states.key(id)).generate_moves([&](const Board &new_board) {
+                    key_type key = new_board.key();
+                    uint32_t new_id = states.find(key, new_board.hash());
+                    if (new_id == state_store::no_parent) {
+                        states.insert(key, id);
+                        counts.push_back(counts[id]);
+                    } else if (new_id >= layer_end) {
+                        counts[new_id] = add_counts(counts[new_id], counts[id]);
+                    }
+                });
+            }
+        }
+    }
+
+    // Number of shortest solutions, 0 if the board can't be solved
+    uint64_t count() const {
+        return solution_count;
+    }
+
+    // Number of moves of each shortest solution
+    uint32_t moves() const {
+        return move_count;
+    }
+
+    // Number of boards discovered by the search
+    size_t board_count() const {
+        return states.size();
+    }
+
+    // Calls callback with the boards on every shortest solution in turn, from the board to the solved board, until it
+    // returns false. Only the solution being built is kept in memory.
+    template<typename F>
+    void for_each(F &&callback) const {
+        std::vector<key_type> path(move_count + 1, key_type(0));
+        for (uint32_t id : solved_ids) {
+            if (!enumerate(id, move_count, path, callback)) {
+                return;
+            }
+        }
+    }
+
+    // Returns the boards on a shortest solution drawn uniformly at random, or an empty path if there is none. Each
+    // step back picks a neighbor in the previous layer with probability proportional to its count.
+    template<typename Random>
+    std::vector<key_type> sample(Random &random) const {
+        if (solved_ids.empty()) {
+            return {};
+        }
+
+        auto pick = [&](uint64_t total, auto &&for_each_candidate) {
+            uint64_t target = std::uniform_int_distribution<uint64_t>(0, total - 1)(random);
+            uint32_t picked = state_store::no_parent;
+            uint32_t last = state_store::no_parent;
+            for_each_candidate([&](uint32_t id) {
+                last = id;
+                if (picked == state_store::no_parent) {
+                    if (target < counts[id]) {
+                        picked = id;
+                    } else {
+                        target -= counts[id];
+                    }
+                }
+            });
+
+            // Only reachable with saturated counts, which don't add up.
+            return picked != state_store::no_parent ? picked : last;
+        };
+
+        std::vector<key_type> path(move_count + 1, key_type(0));
+        uint32_t id = pick(solution_count, [&](auto &&callback) {
+            std::for_each(solved_ids.begin(), solved_ids.end(), callback);
+        });
+
+        for (uint32_t layer = move_count; ; layer--) {
+            path[layer] = states.key(id);
+            if (layer == 0) {
+                return path;
+            }
+
+            id = pick(counts[id], [&](auto &&callback) {
+                for_each_predecessor(id, layer, callback);
+            });
+        }
+    }
+};
@@ -1,117 +1,460 @@
+#include <charconv>
+#include <chrono>
+#include <fstream>
 #include <iostream>
+#include <limits>
 #include <optional>
-#include <queue>
+#include <random>
+#include <sstream>
+#include <string>
+#include <string_view>
+#include <thread>
+#include <vector>
+#include <cerrno>
 #include <cstddef>
+#include <cstdint>
+#include <cstring>
 
-#include <tsl/robin_map.h>
-
+#include "batch.hpp"
 #include "board.hpp"
+#include "board_rank.hpp"
+#include "checkpoint.hpp"
+#include "distance_db.hpp"
+#include "external_search.hpp"
+#include "layout.hpp"
+#include "search.hpp"
+#include "search_stats.hpp"
+#include "shortest_solutions.hpp"
+#include "state_store.hpp"
+
+struct solver_options {
+    static constexpr size_t default_buffer_size = size_t {1} << 22;
+    static constexpr size_t default_checkpoint_interval = 300;
+
+    std::string_view search = "bfs";
+    std::string_view visited = "hash";
+    size_t thread_count = 1;
+    std::optional<size_t> buffer_size; // Boards, default_buffer_size if not given
+    const char *external_path = nullptr;
+    const char *build_db_path = nullptr;
+    const char *db_path = nullptr;
+    const char *checkpoint_path = nullptr;
+    std::optional<size_t> checkpoint_interval; // Seconds, default_checkpoint_interval if not given
+    bool resume = false;
+    bool prune = false;
+    bool hint = false;
+    bool stats = false;
+    bool count = false;
+    size_t enumerate_count = 0;
+    size_t sample_count = 0;
+    std::optional<uint64_t> seed;
+};
 
-static size_t print_solution(game_board board,
-                             const tsl::robin_map<game_board, std::optional<game_board>> &predecessors) {
-    size_t move = 0;
-    auto predecessor = predecessors.at(board);
-    if (predecessor) {
-        move = print_solution(*predecessor, predecessors) + 1;
-        std::cout << "Move " << move << ":\n" << *predecessor << '\n';
+template<typename Board>
+static void print_solution(const std::vector<typename Board::key_type> &path) {
+    std::cout << "Found solution!\n\n";
+    for (size_t move = 1; move < path.size(); move++) {
+        std::cout << "Move " << move << ":\n" << Board(path[move - 1]) << '\n';
     }
 
-    return move;
+    std::cout << "Solution:\n" << Board(path.back()) << '\n';
 }
 
-int main() {
-    game_board board;
-    std::queue<game_board> queue;
-    queue.push(board);
-    tsl::robin_map<game_board, std::optional<game_board>> predecessors;
-    predecessors.insert(std::make_pair(board, std::nullopt));
-
-    while (!queue.empty()) {
-        game_board new_board = queue.front();
-        queue.pop();
-        if (new_board.solved()) {
-            std::cout << "Found solution!\n\n";
-            print_solution(new_board, predecessors);
-            std::cout << "Solution:\n" << new_board << '\n';
-            return 0;
+// Prints the number of shortest solutions, then the first options.enumerate_count of them and options.sample_count
+// more drawn at random, one per line with the layout of every board on the way.
+template<typename Board>
+static int count_solutions(const Board &board, const solver_options &options) {
+    using key_type = typename Board::key_type;
+    shortest_solutions<Board> solutions(board);
+    if (solutions.count() == 0) {
+        std::cout << "No solution found\n";
+        return 1;
+    }
+
+    std::cout << (solutions.count() == std::numeric_limits<uint64_t>::max() ? "At least " : "") << solutions.count()
+              << " shortest solutions of " << solutions.moves() << " moves\n";
+    auto print_path = [](const std::vector<key_type> &path) {
+        for (size_t i = 0; i < path.size(); i++) {
+            std::cout << (i > 0 ? " " : "") << format_layout(Board(path[i]));
         }
 
-        game_board prev_board = new_board;
-        for (auto &piece : new_board.pieces) {
-            new_board = prev_board;
-            if (new_board.move_piece_up_twice(piece) && predecessors.find(new_board) == predecessors.end()) {
-                queue.push(new_board);
-                predecessors[new_board] = prev_board;
-            }
+        std::cout << '\n';
+    };
 
-            new_board = prev_board;
-            if (new_board.move_piece_down_twice(piece) && predecessors.find(new_board) == predecessors.end()) {
-                queue.push(new_board);
-                predecessors[new_board] = prev_board;
-            }
+    size_t enumerated = 0;
+    if (options.enumerate_count > 0) {
+        solutions.for_each([&](const std::vector<key_type> &path) {
+            print_path(path);
+            return ++enumerated < options.enumerate_count;
+        });
+    }
 
-            new_board = prev_board;
-            if (new_board.move_piece_left_twice(piece) && predecessors.find(new_board) == predecessors.end()) {
-                queue.push(new_board);
-                predecessors[new_board] = prev_board;
-            }
+    std::mt19937_64 random(options.seed ? *options.seed : std::random_device()());
+    for (size_t i = 0; i < options.sample_count; i++) {
+        print_path(solutions.sample(random));
+    }
 
-            new_board = prev_board;
-            if (new_board.move_piece_right_twice(piece) && predecessors.find(new_board) == predecessors.end()) {
-                queue.push(new_board);
-                predecessors[new_board] = prev_board;
-            }
+    return 0;
+}
 
-            new_board = prev_board;
-            if (new_board.move_piece_up_left(piece) && predecessors.find(new_board) == predecessors.end()) {
-                queue.push(new_board);
-                predecessors[new_board] = prev_board;
-            }
+template<typename Board>
+static int solve(const Board &board, const solver_options &options) {
+    using key_type = typename Board::key_type;
+    if (options.build_db_path) {
+        if (count_solved_boards(board) > max_solved_boards) {
+            std::cerr << "Too many solved boards for --build-db (more than " << max_solved_boards << ")\n";
+            return 1;
+        }
 
-            new_board = prev_board;
-            if (new_board.move_piece_up_right(piece) && predecessors.find(new_board) == predecessors.end()) {
-                queue.push(new_board);
-                predecessors[new_board] = prev_board;
-            }
+        std::optional<size_t> board_count = build_distance_db(board, options.build_db_path);
+        if (!board_count) {
+            std::cerr << "Failed to write " << options.build_db_path << '\n';
+            return 1;
+        }
 
-            new_board = prev_board;
-            if (new_board.move_piece_bottom_left(piece) && predecessors.find(new_board) == predecessors.end()) {
-                queue.push(new_board);
-                predecessors[new_board] = prev_board;
-            }
+        std::cout << "Wrote " << *board_count << " boards to " << options.build_db_path << '\n';
+        return 0;
+    }
 
-            new_board = prev_board;
-            if (new_board.move_piece_bottom_right(piece) && predecessors.find(new_board) == predecessors.end()) {
-                queue.push(new_board);
-                predecessors[new_board] = prev_board;
+    distance_db<Board> db;
+    if (options.db_path && !db.open(options.db_path, board)) {
+        std::cerr << "Distance database " << options.db_path << " can't be read or isn't for these pieces\n";
+        return 1;
+    }
+
+    if (options.hint) {
+        std::optional<uint32_t> distance = db.distance(board.key());
+        if (!distance) {
+            std::cout << "No solution found\n";
+            return 1;
+        }
+
+        std::cout << "Moves left: " << *distance << '\n';
+        if (std::optional<key_type> next_key = db.next_move(board)) {
+            std::cout << "Next move:\n" << Board(*next_key) << '\n';
+        }
+
+        return 0;
+    }
+
+    if (options.count) {
+        return count_solutions(board, options);
+    }
+
+    if (options.visited == "bitset" && board_ranker<Board>(board).size() > basic_state_store<Board>::no_parent) {
+        std::cerr << "Too many board placements for --visited bitset\n";
+        return 1;
+    }
+
+    std::vector<key_type> path;
+    if (options.external_path) {
+        std::optional<std::vector<key_type>> external_path;
+        size_t buffer_size = options.buffer_size.value_or(solver_options::default_buffer_size);
+        if (options.stats) {
+            search_stats stats(&std::cerr);
+            external_path = external_breadth_first_search(board, options.external_path, buffer_size, stats);
+            stats.write_json(std::cerr);
+        } else {
+            external_path = external_breadth_first_search(board, options.external_path, buffer_size);
+        }
+
+        if (!external_path) {
+            int error = errno;
+            std::cerr << "Failed to read or write the layer files in " << options.external_path
+                      << (error ? std::string(": ") + std::strerror(error) : std::string()) << '\n';
+            return 1;
+        }
+
+        path = std::move(*external_path);
+    } else if (options.db_path) {
+        if (db.distance(board.key())) {
+            path.push_back(board.key());
+            while (std::optional<key_type> next_key = db.next_move(Board(path.back()))) {
+                path.push_back(*next_key);
             }
+        }
+    } else if (options.search == "bidirectional") {
+        path = bidirectional_search(board);
+    } else if (options.search == "astar") {
+        path = a_star_search(board);
+    } else if (options.search == "idastar") {
+        path = ida_star_search(board);
+    } else if (options.visited == "bitset") {
+        path = ranked_breadth_first_search(board);
+    } else {
+        // With --prune, a quick search first bounds the number of moves of the shortest solution, or finds that there
+        // is no solution at all.
+        uint32_t move_limit = unlimited_moves;
+        if (options.prune) {
+            std::optional<uint32_t> upper_bound = solution_length_upper_bound(board);
+            if (!upper_bound) {
+                std::cout << "No solution found\n";
+                return 1;
+            }
+
+            move_limit = *upper_bound;
+        }
 
-            new_board = prev_board;
-            if (new_board.move_piece_up(piece) && predecessors.find(new_board) == predecessors.end()) {
-                queue.push(new_board);
-                predecessors[new_board] = prev_board;
+        basic_state_store<Board> states;
+        if (options.resume) {
+            checkpoint_status status = read_checkpoint(board, states, options.checkpoint_path);
+            if (status == checkpoint_status::invalid) {
+                std::cerr << "Checkpoint " << options.checkpoint_path << " can't be read or isn't for this board\n";
+                return 1;
             }
 
-            new_board = prev_board;
-            if (new_board.move_piece_down(piece) && predecessors.find(new_board) == predecessors.end()) {
-                queue.push(new_board);
-                predecessors[new_board] = prev_board;
+            if (status == checkpoint_status::loaded) {
+                std::cerr << "Resuming at depth " << states.layer_count() - 1 << " with " << states.size()
+                          << " boards\n";
             }
+        }
 
-            new_board = prev_board;
-            if (new_board.move_piece_left(piece) && predecessors.find(new_board) == predecessors.end()) {
-                queue.push(new_board);
-                predecessors[new_board] = prev_board;
+        if (states.size() == 0) {
+            states.insert(board.key(), basic_state_store<Board>::no_parent);
+        }
+
+        // Save the search at the end of the first layer done checkpoint_interval after the previous checkpoint.
+        // Failing to write one isn't fatal: the search goes on, and the previous checkpoint is kept.
+        std::chrono::seconds interval(
+            options.checkpoint_interval.value_or(solver_options::default_checkpoint_interval));
+        auto last_checkpoint = std::chrono::steady_clock::now();
+        auto layer_done = [&] {
+            auto now = std::chrono::steady_clock::now();
+            if (!options.checkpoint_path || now - last_checkpoint < interval) {
+                return;
             }
 
-            new_board = prev_board;
-            if (new_board.move_piece_right(piece) && predecessors.find(new_board) == predecessors.end()) {
-                queue.push(new_board);
-                predecessors[new_board] = prev_board;
+            if (!write_checkpoint(states, options.checkpoint_path)) {
+                std::cerr << "Failed to write checkpoint " << options.checkpoint_path << '\n';
             }
+
+            last_checkpoint = std::chrono::steady_clock::now();
+        };
+
+        auto search = [&](auto &&stats) {
+            return options.thread_count > 1
+                       ? parallel_breadth_first_search(states, options.thread_count, stats, layer_done, move_limit)
+                       : breadth_first_search(states, stats, layer_done, move_limit);
+        };
+
+        uint32_t id;
+        if (options.stats) {
+            search_stats stats(&std::cerr, states.layer_count() - 1);
+            id = search(stats);
+            stats.finish(states);
+            stats.write_json(std::cerr);
+        } else {
+            id = search(null_search_stats());
+        }
+        if (id != basic_state_store<Board>::no_parent) {
+            path = solution_path(states, id);
+        }
+    }
+
+    if (path.empty()) {
+        std::cout << "No solution found\n";
+        return 1;
+    }
+
+    print_solution<Board>(path);
+    return 0;
+}
+
+// Reads the whole file, or standard input if path is "-".
+static std::optional<std::string> read_file(const char *path) {
+    std::ostringstream contents;
+    if (std::string_view(path) == "-") {
+        contents << std::cin.rdbuf();
+        return contents.str();
+    }
+
+    std::ifstream file(path);
+    if (!file || !(contents << file.rdbuf())) {
+        return std::nullopt;
+    }
+
+    return contents.str();
+}
+
+static bool parse_count(std::string_view arg, size_t &count) {
+    auto [end, error] = std::from_chars(arg.data(), arg.data() + arg.size(), count);
+    return error == std::errc() && end == arg.data() + arg.size();
+}
+
+static void print_usage(const char *name) {
+    std::cerr << "Usage: " << name << " [--layout FILE] [--search bfs|bidirectional|astar|idastar] [--threads N]\n"
+              << "       " << name << " [--layout FILE] [--visited hash|bitset] [--prune] [--stats]\n"
+              << "       " << name << " [--layout FILE] --build-db FILE\n"
+              << "       " << name << " [--layout FILE] --db FILE [--hint]\n"
+              << "       " << name << " [--layout FILE] --external DIR [--buffer N] [--stats]\n"
+              << "       " << name << " [--layout FILE] [--threads N] --checkpoint FILE [--interval S] [--resume]\n"
+              << "       " << name << " [--layout FILE] --count [--enumerate N] [--sample N [--seed S]]\n"
+              << "       " << name << " --batch FILE [--threads N]\n"
+              << "  --layout FILE    Read the initial board from FILE ('-' for standard input) instead of using the\n"
+              << "                   Royal Escape board\n"
+              << "  --search S       Search algorithm to use (default: bfs)\n"
+              << "  --threads N      Expand each breadth-first search layer on N threads (0 uses all available cores)\n"
+              << "  --visited V      Visited set used by the breadth-first search (default: hash)\n"
+              << "  --prune          Skip the boards that can't be on a solution as short as one found by a quick\n"
+              << "                   search beforehand\n"
+              << "  --build-db FILE  Write the distance to the solution of every solvable board to FILE\n"
+              << "  --db FILE        Follow the distances in FILE instead of searching\n"
+              << "  --hint           Only print the number of moves left and the next move\n"
+              << "  --external DIR   Run a breadth-first search that keeps its layers in files in DIR, not in memory\n"
+              << "  --buffer N       Boards buffered in memory by --external before sorting them to disk\n"
+              << "                   (default: 4194304)\n"
+              << "  --checkpoint F   Save the breadth-first search to F between layers, every --interval seconds\n"
+              << "                   (default: 300)\n"
+              << "  --resume         Resume the search from the --checkpoint file, if there is one\n"
+              << "  --count          Print the number of shortest solutions\n"
+              << "  --enumerate N    With --count, also print the first N shortest solutions, one per line\n"
+              << "  --sample N       With --count, also print N shortest solutions drawn uniformly at random\n"
+              << "  --seed S         Seed of the random draws of --sample (default: random)\n"
+              << "  --stats          Print progress and search statistics (as JSON, once done) to standard error\n"
+              << "  --batch FILE     Solve every layout in FILE ('-' for standard input), one per line, on\n"
+              << "                   --threads threads, and print one record per layout as soon as it is solved\n";
+}
+
+int main(int argc, char *argv[]) {
+    solver_options options;
+    const char *layout_path = nullptr;
+    const char *batch_path = nullptr;
+    for (int i = 1; i < argc; i++) {
+        std::string_view arg = argv[i];
+        if (arg == "--search" && i + 1 < argc) {
+            options.search = argv[++i];
+        } else if (arg == "--visited" && i + 1 < argc) {
+            options.visited = argv[++i];
+        } else if (arg == "--build-db" && i + 1 < argc) {
+            options.build_db_path = argv[++i];
+        } else if (arg == "--db" && i + 1 < argc) {
+            options.db_path = argv[++i];
+        } else if (arg == "--batch" && i + 1 < argc) {
+            batch_path = argv[++i];
+        } else if (arg == "--external" && i + 1 < argc) {
+            options.external_path = argv[++i];
+        } else if (size_t buffer_size; arg == "--buffer" && i + 1 < argc && parse_count(argv[i + 1], buffer_size)) {
+            options.buffer_size = buffer_size;
+            i++;
+        } else if (arg == "--layout" && i + 1 < argc) {
+            layout_path = argv[++i];
+        } else if (arg == "--checkpoint" && i + 1 < argc) {
+            options.checkpoint_path = argv[++i];
+        } else if (size_t interval; arg == "--interval" && i + 1 < argc && parse_count(argv[i + 1], interval)) {
+            options.checkpoint_interval = interval;
+            i++;
+        } else if (arg == "--prune") {
+            options.prune = true;
+        } else if (arg == "--resume") {
+            options.resume = true;
+        } else if (arg == "--hint") {
+            options.hint = true;
+        } else if (arg == "--stats") {
+            options.stats = true;
+        } else if (arg == "--count") {
+            options.count = true;
+        } else if (arg == "--enumerate" && i + 1 < argc && parse_count(argv[i + 1], options.enumerate_count)) {
+            i++;
+        } else if (arg == "--sample" && i + 1 < argc && parse_count(argv[i + 1], options.sample_count)) {
+            i++;
+        } else if (size_t seed; arg == "--seed" && i + 1 < argc && parse_count(argv[i + 1], seed)) {
+            options.seed = seed;
+            i++;
+        } else if (arg == "--threads" && i + 1 < argc && parse_count(argv[i + 1], options.thread_count)) {
+            i++;
+        } else {
+            print_usage(argv[0]);
+            return 2;
         }
     }
 
-    std::cout << "No solution found\n";
-    return 1;
+    std::string_view search = options.search;
+    std::string_view visited = options.visited;
+    bool known_search = search == "bfs" || search == "bidirectional" || search == "astar" || search == "idastar";
+    bool known_visited = visited == "hash" || visited == "bitset";
+
+    // --threads and --visited only apply to the breadth-first search, and only one of them can be used at a time.
+    bool valid_bfs_options = (options.thread_count == 1 || (search == "bfs" && visited == "hash")) &&
+                             (visited == "hash" || search == "bfs");
+    bool valid_db_options = (!options.hint || options.db_path) && !(options.build_db_path && options.db_path);
+
+    // The batch mode always runs the breadth-first search, with --threads giving the number of layouts solved at once.
+    bool valid_batch_options = !batch_path || (search == "bfs" && visited == "hash" && !layout_path &&
+                                               !options.build_db_path && !options.db_path);
+    valid_bfs_options = valid_bfs_options || batch_path;
+
+    // --external replaces the breadth-first search and its visited set, and --stats only applies to the
+    // breadth-first searches.
+    bool valid_external_options = (options.external_path || !options.buffer_size) &&
+                                  (!options.external_path || (search == "bfs" && visited == "hash" &&
+                                                              options.thread_count == 1 && !batch_path &&
+                                                              !options.build_db_path && !options.db_path));
+    bool valid_stats_options = !options.stats || (search == "bfs" && visited == "hash" && !batch_path &&
+                                                  !options.build_db_path && !options.db_path);
+
+    // --count runs its own breadth-first search, which --enumerate, --sample and --seed apply to.
+    bool valid_count_options = (options.count || (!options.enumerate_count && !options.sample_count)) &&
+                               (options.sample_count || !options.seed) &&
+                               (!options.count || (search == "bfs" && visited == "hash" &&
+                                                   options.thread_count == 1 && !batch_path && !options.external_path &&
+                                                   !options.build_db_path && !options.db_path && !options.stats));
+
+    // Checkpoints save the visited set of the in-memory breadth-first search.
+    bool valid_checkpoint_options = (options.checkpoint_path || (!options.resume && !options.checkpoint_interval)) &&
+                                    (!options.checkpoint_path || (search == "bfs" && visited == "hash" &&
+                                                                  !batch_path && !options.external_path &&
+                                                                  !options.build_db_path && !options.db_path &&
+                                                                  !options.count));
+
+    // --prune bounds the in-memory breadth-first search.
+    bool valid_prune_options = !options.prune || (search == "bfs" && visited == "hash" && !batch_path &&
+                                                  !options.external_path && !options.build_db_path &&
+                                                  !options.db_path && !options.count);
+    if (!known_search || !known_visited || !valid_bfs_options || !valid_db_options || !valid_batch_options ||
+        !valid_external_options || !valid_stats_options || !valid_count_options || !valid_checkpoint_options ||
+        !valid_prune_options) {
+        print_usage(argv[0]);
+        return 2;
+    }
+
+    if (options.thread_count == 0) {
+        options.thread_count = std::max(std::thread::hardware_concurrency(), 1U);
+    }
+
+    if (batch_path) {
+        if (std::string_view(batch_path) == "-") {
+            solve_batch(std::cin, std::cout, options.thread_count);
+            return 0;
+        }
+
+        std::ifstream file(batch_path);
+        if (!file) {
+            std::cerr << "Failed to read " << batch_path << '\n';
+            return 1;
+        }
+
+        solve_batch(file, std::cout, options.thread_count);
+        return 0;
+    }
+
+    std::optional<std::string> layout_text = std::string(default_layout);
+    if (layout_path && !(layout_text = read_file(layout_path))) {
+        std::cerr << "Failed to read " << layout_path << '\n';
+        return 1;
+    }
+
+    std::optional<board_layout> layout = parse_layout(*layout_text);
+    if (!layout) {
+        std::cerr << "Invalid layout\n";
+        return 1;
+    }
+
+    int status = 0;
+    if (!with_board(*layout, [&](const auto &board) { status = solve(board, options); })) {
+        std::cerr << "Unsupported layout: " << layout->width << 'x' << layout->height << " with "
+                  << layout->pieces.size() << " pieces\n";
+        return 1;
+    }
+
+    return status;
 }
@@ -0,0 +1,157 @@
+#pragma once
+
+#include <algorithm>
+#include <array>
+#include <functional>
+#include <limits>
+#include <vector>
+#include <cassert>
+#include <cstddef>
+#include <cstdint>
+
+#include <tsl/robin_map.h>
+
+#include "board.hpp"
+
+// Visited set for the search. Every discovered board is assigned a dense 32-bit id: boards are stored as packed keys
+// in an append-only arena, with the id of the board they were reached from in a parallel array. Ids are handed out in
+// discovery order, so for a breadth-first search the arena doubles as the search queue. The arena is split into
+// layers: each layer is a contiguous range of ids, and new boards go into the last one until add_layer() starts the
+// next, so a breadth-first search keeps one layer per depth without a separate frontier.
+//
+// The key to id map is split into shards by the top bits of the key hash, which lets the parallel search fill
+// different shards from different threads. Keys are hashed with the Zobrist hash that boards carry, so the searches
+// pass Board::hash() along instead of hashing each key they look up; the maps store the hash of every key to grow
+// without hashing them again.
+template<typename Board>
+class basic_state_store {
+public:
+    using board_type = Board;
+    using key_type = typename Board::key_type;
+    using key_hash = typename Board::key_hash;
+    using id_map = tsl::robin_map<key_type, uint32_t, key_hash, std::equal_to<key_type>,
+                                  std::allocator<std::pair<key_type, uint32_t>>, true>;
+
+    static constexpr uint32_t no_parent = std::numeric_limits<uint32_t>::max();
+    static constexpr size_t shard_bits = 6;
+    static constexpr size_t shard_count = 1U << shard_bits;
+
+private:
+    std::vector<key_type> keys;
+    std::vector<uint32_t> parents;
+    std::vector<uint32_t> layer_begins = { 0 };
+    std::array<id_map, shard_count> shards;
+
+public:
+    static size_t shard_index(size_t hash) {
+        return hash >> (std::numeric_limits<size_t>::digits - shard_bits);
+    }
+
+    // Returns false if the board has already been visited.
+    bool insert(key_type key, uint32_t parent) {
+        assert(keys.size() < no_parent);
+        id_map &ids = shards[shard_index(key_hash()(key))];
+        if (!ids.try_emplace(key, static_cast<uint32_t>(keys.size())).second) {
+            return false;
+        }
+
+        keys.push_back(key);
+        parents.push_back(parent);
+        return true;
+    }
+
+    // Same, for a key whose hash is already known. robin-map can only take a precalculated hash for lookups, so the
+    // key is looked up with it first, and hashed again by robin-map only if it is new.
+    bool insert(key_type key, size_t hash, uint32_t parent) {
+        assert(keys.size() < no_parent);
+        id_map &ids = shards[shard_index(hash)];
+        if (ids.find(key, hash) != ids.end()) {
+            return false;
+        }
+
+        ids.emplace(key, static_cast<uint32_t>(keys.size()));
+        keys.push_back(key);
+        parents.push_back(parent);
+        return true;
+    }
+
+    // Returns the id of the board, or no_parent if it hasn't been visited.
+    uint32_t find(key_type key) const {
+        return find(key, key_hash()(key));
+    }
+
+    uint32_t find(key_type key, size_t hash) const {
+        const id_map &ids = shards[shard_index(hash)];
+        auto it = ids.find(key, hash);
+        return it != ids.end() ? it->second : no_parent;
+    }
+
+    bool contains(key_type key, size_t hash) const {
+        const id_map &ids = shards[shard_index(hash)];
+        return ids.find(key, hash) != ids.end();
+    }
+
+    key_type key(uint32_t id) const {
+        return keys[id];
+    }
+
+    uint32_t parent(uint32_t id) const {
+        return parents[id];
+    }
+
+    size_t size() const {
+        return keys.size();
+    }
+
+    // Starts a new layer, which the boards inserted from now on go into.
+    void add_layer() {
+        layer_begins.push_back(static_cast<uint32_t>(keys.size()));
+    }
+
+    size_t layer_count() const {
+        return layer_begins.size();
+    }
+
+    uint32_t layer_begin(size_t layer) const {
+        return layer_begins[layer];
+    }
+
+    uint32_t layer_end(size_t layer) const {
+        return layer + 1 < layer_begins.size() ? layer_begins[layer + 1] : static_cast<uint32_t>(keys.size());
+    }
+
+    // Layer the board with the given id is in: its depth, for a breadth-first search.
+    size_t layer(uint32_t id) const {
+        return std::upper_bound(layer_begins.begin(), layer_begins.end(), id) - layer_begins.begin() - 1;
+    }
+
+    // Forgets every board, but keeps the memory allocated for them so that the store can be reused for another search
+    // without reallocating.
+    void clear() {
+        keys.clear();
+        parents.clear();
+        layer_begins.assign(1, 0);
+        for (id_map &ids : shards) {
+            ids.clear();
+        }
+    }
+
+    // Low-level access for the parallel search, which fills a whole layer at once: it grows the arena, then assigns
+    // the new ids and updates the shards itself.
+    id_map &shard(size_t index) {
+        return shards[index];
+    }
+
+    void resize(size_t size) {
+        assert(size <= no_parent);
+        keys.resize(size, key_type(0));
+        parents.resize(size, no_parent);
+    }
+
+    void assign(uint32_t id, key_type key, uint32_t parent) {
+        keys[id] = key;
+        parents[id] = parent;
+    }
+};
+
+using state_store = basic_state_store<game_board>;